@@ -0,0 +1,126 @@
+#pragma once
+#ifndef BIWORDS_HPP
+#define BIWORDS_HPP
+
+#include "../Extensions/Posting.hpp"
+#include <fstream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Postings of word pairs that stand next to each other (biwords)
+// A pair's posting lists the docs where the second word directly follows the first,
+// with the positions of the first word, so a two-word phrase is one posting scan
+// and a longer phrase only has to check where its biwords line up
+// Pairs are collected while indexing; build() then keeps only the frequent ones
+class Biwords
+{
+public:
+    Biwords() = default;
+    Biwords(const Biwords &) = delete;
+    Biwords &operator=(const Biwords &) = delete;
+
+    // Docs must come in increasing ID order, as they do for the dictionary
+    void add(const std::string &first, const std::string &second, const unsigned &doc_ID, const unsigned &pos)
+    {
+        pairs[first + " " + second].push_directly(doc_ID, pos);
+    }
+
+    // Drops the pairs found in fewer than min_docs docs, except those in keep
+    // (e.g. pairs from phrases that are often asked for)
+    void prune(const unsigned &min_docs, const std::set<std::string> &keep)
+    {
+        for (auto it = pairs.begin(); it != pairs.end();)
+        {
+            if (it->second.doc_count < min_docs && !keep.count(it->first))
+                it = pairs.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    // Returns nullptr if the pair was not kept
+    const Posting *search(const std::string &first, const std::string &second) const
+    {
+        auto found = pairs.find(first + " " + second);
+        return found == pairs.end() ? nullptr : &found->second;
+    }
+
+    // Calls visit(pair, posting) for every pair
+    template <typename Visitor>
+    void for_each(Visitor visit)
+    {
+        for (auto &pair : pairs)
+            visit(pair.first, &pair.second);
+    }
+
+    size_t size() const
+    {
+        return pairs.size();
+    }
+
+    // Bytes of the postings, skips and positions, as MemoryReport counts them
+    unsigned long long bytes() const
+    {
+        unsigned long long total = 0;
+        for (const auto &pair : pairs)
+        {
+            total += pair.first.capacity() + sizeof(Posting) + pair.second.skips.bytes();
+            for (auto doc = pair.second.documents.begin(); doc != nullptr; doc = doc->next)
+                total += sizeof(Node<Document>) + doc->data.term_freq * sizeof(Node<unsigned>);
+        }
+        return total;
+    }
+
+    void clear()
+    {
+        pairs.clear();
+    }
+
+    // One line per pair: "<first> <second> <doc count> (<doc ID> <freq> <position>*)*"
+    void write(std::ostream &out) const
+    {
+        for (const auto &pair : pairs)
+        {
+            out << pair.first << " " << pair.second.doc_count << " ";
+            for (auto doc = pair.second.documents.begin(); doc != nullptr; doc = doc->next)
+            {
+                out << doc->data.ID << " " << doc->data.term_freq << " ";
+                for (auto pos = doc->data.positions.begin(); pos != nullptr; pos = pos->next)
+                    out << pos->data << " ";
+            }
+            out << "\n";
+        }
+    }
+
+    // Reads what write() wrote; returns false if the file is missing or cut short
+    bool read(std::istream &in)
+    {
+        clear();
+        std::string first, second;
+        unsigned doc_count, doc_ID, term_freq, pos;
+        while (in >> first >> second >> doc_count)
+        {
+            Posting &posting = pairs[first + " " + second];
+            for (unsigned i = 0; i < doc_count; i++)
+            {
+                if (!(in >> doc_ID >> term_freq))
+                    return false;
+                for (unsigned j = 0; j < term_freq; j++)
+                {
+                    if (!(in >> pos))
+                        return false;
+                    posting.push_directly(doc_ID, pos);
+                }
+            }
+        }
+        return in.eof();
+    }
+
+private:
+    std::unordered_map<std::string, Posting> pairs; // "<first> <second>" -> posting
+};
+
+#endif
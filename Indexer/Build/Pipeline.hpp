@@ -0,0 +1,284 @@
+#pragma once
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "../Exec/BoundedQueue.hpp"
+#include "../Storage/FileSource.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Indexing in stages that run at the same time:
+//   read      whole files come in through a FileSource, many reads at a time,
+//             in whatever order they complete
+//   tokenize  any number of threads split, case fold, drop stopwords and stem,
+//             grouping each doc's positions by term
+//   invert    the calling thread adds each doc to the dictionary, one lookup per term
+// Bounded queues between the stages let reading overlap the CPU work while
+// keeping at most a queue's worth of docs in flight
+class Pipeline
+{
+public:
+    struct Doc
+    {
+        unsigned long long sequence{0}; // order the docs must be inverted in
+        unsigned ID{0};
+        std::string text;
+    };
+
+    // One doc's terms, each with its ascending positions
+    struct Terms
+    {
+        unsigned long long sequence{0};
+        unsigned ID{0};
+        std::vector<std::pair<std::string, std::vector<unsigned>>> terms;
+        std::string text; // the doc as read, if run() was asked to keep it
+    };
+
+    struct StageStats
+    {
+        std::string name;
+        unsigned threads{0};
+        unsigned long long items{0};
+        unsigned long long bytes{0};
+        unsigned long long busy_ns{0}; // summed over the stage's threads
+        unsigned long long stalls{0};  // pushes that found the next queue full
+    };
+
+    struct QueueStats
+    {
+        std::string name;
+        size_t capacity{0};
+        size_t max_depth{0};
+        unsigned long long depth_sum{0}; // sampled at every push
+        unsigned long long samples{0};
+    };
+
+    struct Stats
+    {
+        std::vector<StageStats> stages;
+        std::vector<QueueStats> queues;
+        double seconds{0};
+        FileSource::Method source{FileSource::SYNC}; // how the files were read
+        std::vector<std::string> unreadable; // files indexed as empty docs, as they could not be read
+
+        // The stage with the least spare time is the bottleneck: its threads
+        // are busy for the largest share of the run
+        void print(std::ostream &out) const
+        {
+            out << std::left << std::setw(10) << "Stage" << std::right
+                << std::setw(8) << "Threads" << std::setw(10) << "Docs" << std::setw(12) << "MB"
+                << std::setw(12) << "Docs/s" << std::setw(8) << "Busy" << std::setw(10) << "Stalls" << "\n";
+            for (const auto &stage : stages)
+            {
+                const double busy = seconds > 0 && stage.threads ? stage.busy_ns / 1e9 / seconds / stage.threads : 0;
+                out << std::left << std::setw(10) << stage.name << std::right
+                    << std::setw(8) << stage.threads << std::setw(10) << stage.items
+                    << std::setw(12) << std::fixed << std::setprecision(2) << stage.bytes / 1e6
+                    << std::setw(12) << std::setprecision(0) << (stage.busy_ns ? stage.items * 1e9 * stage.threads / stage.busy_ns : 0)
+                    << std::setw(7) << std::setprecision(0) << 100 * busy << "%"
+                    << std::setw(10) << stage.stalls << "\n";
+            }
+            for (const auto &queue : queues)
+                out << "Queue " << queue.name << ": capacity " << queue.capacity
+                    << ", mean depth " << std::setprecision(1)
+                    << (queue.samples ? double(queue.depth_sum) / queue.samples : 0)
+                    << ", max depth " << queue.max_depth << "\n";
+            out.unsetf(std::ios::floatfield);
+            out << "Files read with " << FileSource::name(source) << "\n";
+            if (!unreadable.empty())
+            {
+                out << "Could not read " << unreadable.size() << " file(s):";
+                for (const auto &filename : unreadable)
+                    out << " " << filename;
+                out << "\n";
+            }
+            out << "Total: " << std::setprecision(3) << seconds << " s\n" << std::setprecision(6);
+        }
+    };
+
+    // Runs the pipeline over files, given as (filename, doc ID) in the order to invert them
+    // keep(word) says whether a case-folded word is indexed and may rewrite it (stopwords, stemming);
+    // it is called from several threads at once
+    // invert(terms) is only ever called from the calling thread, in the order of files
+    // With keep_text the text of each doc is handed on to invert() with its terms
+    // The read stage's busy time is its threads' time less the time they waited for room
+    template <typename Keep, typename Invert>
+    static Stats run(const std::vector<std::pair<std::string, unsigned>> &files, Keep keep, Invert invert,
+                     unsigned tokenizers = 0, const size_t &queue_size = 64,
+                     const FileSource::Method &source = FileSource::AUTO, const bool &keep_text = false)
+    {
+        if (tokenizers == 0)
+            tokenizers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+        Stats stats;
+        stats.stages = {StageStats{"read", 1}, StageStats{"tokenize", tokenizers}, StageStats{"invert", 1}};
+        stats.queues = {QueueStats{"read->tokenize"}, QueueStats{"tokenize->invert"}};
+        std::vector<StageStats> tokenizer_stats(tokenizers);
+        std::vector<QueueStats> tokenized_depths(tokenizers);
+
+        BoundedQueue<Doc> read_queue(queue_size);
+        BoundedQueue<Terms> term_queue(queue_size);
+        stats.queues[0].capacity = read_queue.capacity();
+        stats.queues[1].capacity = term_queue.capacity();
+        const auto start = Clock::now();
+
+        std::thread reader([&]()
+        {
+            StageStats &stage = stats.stages[0];
+            std::mutex lock; // emit() may be called from several reading threads
+            unsigned long long waited_ns = 0;
+            const auto begin = Clock::now();
+            stats.source = FileSource::read(files, [&](const size_t &i, std::string &&text, const bool &read)
+            {
+                Doc doc;
+                doc.sequence = i;
+                doc.ID = files[i].second;
+                doc.text = std::move(text);
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    if (!read)
+                        stats.unreadable.push_back(files[i].first);
+                    stage.items++;
+                    stage.bytes += doc.text.size();
+                    sample(stats.queues[0], read_queue.depth());
+                }
+                const auto pushed = Clock::now();
+                if (read_queue.push(std::move(doc)))
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    stage.stalls++;
+                    waited_ns += nanos_since(pushed);
+                }
+            }, source, stage.threads);
+            const unsigned long long total_ns = nanos_since(begin) * stage.threads;
+            stage.busy_ns = total_ns > waited_ns ? total_ns - waited_ns : 0;
+            read_queue.close();
+        });
+
+        std::atomic<unsigned> tokenizing{tokenizers};
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < tokenizers; t++)
+        {
+            workers.emplace_back([&, t]()
+            {
+                StageStats &stage = tokenizer_stats[t];
+                Doc doc;
+                while (read_queue.pop(doc))
+                {
+                    const auto begin = Clock::now();
+                    Terms terms = tokenize(doc, keep);
+                    stage.items++;
+                    stage.bytes += doc.text.size();
+                    if (keep_text)
+                        terms.text = std::move(doc.text);
+                    stage.busy_ns += nanos_since(begin);
+                    sample(tokenized_depths[t], term_queue.depth());
+                    stage.stalls += term_queue.push(std::move(terms));
+                }
+                if (--tokenizing == 0)
+                    term_queue.close();
+            });
+        }
+
+        // Tokenizers finish out of order; docs wait here until their turn
+        StageStats &stage = stats.stages[2];
+        std::map<unsigned long long, Terms> early;
+        unsigned long long next = 0;
+        Terms terms;
+        while (term_queue.pop(terms))
+        {
+            early.emplace(terms.sequence, std::move(terms));
+            for (auto it = early.begin(); it != early.end() && it->first == next; it = early.erase(it), next++)
+            {
+                const auto begin = Clock::now();
+                invert(it->second);
+                stage.items++;
+                stage.busy_ns += nanos_since(begin);
+            }
+        }
+
+        reader.join();
+        for (auto &worker : workers)
+            worker.join();
+        stats.seconds = nanos_since(start) / 1e9;
+
+        for (unsigned t = 0; t < tokenizers; t++)
+        {
+            stats.stages[1].items += tokenizer_stats[t].items;
+            stats.stages[1].bytes += tokenizer_stats[t].bytes;
+            stats.stages[1].busy_ns += tokenizer_stats[t].busy_ns;
+            stats.stages[1].stalls += tokenizer_stats[t].stalls;
+            stats.queues[1].max_depth = std::max(stats.queues[1].max_depth, tokenized_depths[t].max_depth);
+            stats.queues[1].depth_sum += tokenized_depths[t].depth_sum;
+            stats.queues[1].samples += tokenized_depths[t].samples;
+        }
+        stats.stages[2].bytes = stats.stages[1].bytes;
+        return stats;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static unsigned long long nanos_since(const Clock::time_point &begin)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+    }
+
+    static void sample(QueueStats &queue, const size_t &depth)
+    {
+        queue.max_depth = std::max(queue.max_depth, depth);
+        queue.depth_sum += depth;
+        queue.samples++;
+    }
+
+    // The same words and positions Indexer::index() finds: letters and digits make up
+    // words, other characters are dropped, and every space or newline moves to the next position
+    template <typename Keep>
+    static Terms tokenize(const Doc &doc, Keep &keep)
+    {
+        Terms result;
+        result.sequence = doc.sequence;
+        result.ID = doc.ID;
+        std::unordered_map<std::string, size_t> slot; // term -> its place in result.terms
+
+        std::string word;
+        unsigned pos = 0;
+        auto add = [&]()
+        {
+            if (word.length() && keep(word))
+            {
+                auto found = slot.emplace(word, result.terms.size());
+                if (found.second)
+                    result.terms.emplace_back(word, std::vector<unsigned>());
+                result.terms[found.first->second].second.push_back(pos);
+            }
+            word.clear();
+        };
+        for (const char &c : doc.text)
+        {
+            if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+                word.push_back(c);
+            else if (c >= 'A' && c <= 'Z')
+                word.push_back(c | 32); // case folding
+            else if (c == ' ' || c == '\n')
+            {
+                add();
+                pos++;
+            }
+        }
+        add(); // the last word
+        return result;
+    }
+};
+
+#endif
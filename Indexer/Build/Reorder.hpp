@@ -0,0 +1,326 @@
+#pragma once
+#ifndef REORDER_HPP
+#define REORDER_HPP
+
+#include "../Tries/Trie.hpp"
+#include "../Query/Cursor.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <numeric>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// Offline doc ID reordering by recursive graph bisection
+// Docs sharing many terms end up with nearby IDs, so d-gaps shrink
+// and the docs matching a query cluster together
+class Reorder
+{
+public:
+    // Size and speed of the doc-level postings under the current numbering
+    struct Stats
+    {
+        unsigned long long postings{0};
+        unsigned long long gap_bytes{0}; // postings as variable-byte encoded d-gaps
+        unsigned long long gamma_bits{0}; // postings as Elias-gamma coded d-gaps (finer than bytes)
+        double decode_ns{0};             // time to decode all of gap_bytes
+        double intersect_ns{0};          // time to AND the most frequent terms pairwise
+
+        void print(std::ostream &out, const char *label) const
+        {
+            out << label << ": "
+                << postings << " postings, "
+                << gap_bytes << " bytes as d-gaps ("
+                << (postings ? 8.0 * gap_bytes / postings : 0) << " bits/posting), "
+                << (postings ? double(gamma_bits) / postings : 0) << " gamma bits/posting, decode "
+                << decode_ns / 1e6 << " ms, intersect "
+                << intersect_ns / 1e6 << " ms\n";
+        }
+    };
+
+    // Returns new_ID[old_ID] for doc IDs 1..max_doc (new_ID[0] is unused)
+    static std::vector<unsigned> bisection(Trie &dictionary, const unsigned &max_doc,
+                                           const unsigned &iterations = 20)
+    {
+        // Forward index: the terms of every doc
+        std::vector<std::vector<unsigned>> terms(max_doc + 1);
+        std::vector<unsigned> doc_counts;
+        dictionary.for_each([&](const std::string &, Posting *posting)
+        {
+            for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next)
+            {
+                if (doc->data.ID <= max_doc)
+                    terms[doc->data.ID].push_back(doc_counts.size());
+            }
+            doc_counts.push_back(posting->doc_count);
+        });
+        const unsigned term_count = doc_counts.size();
+
+        // Start from a term-signature sort: docs are ordered by which of the
+        // most frequent terms they contain, so bisection starts from rough clusters
+        std::vector<unsigned> rank(term_count);
+        std::iota(rank.begin(), rank.end(), 0);
+        std::stable_sort(rank.begin(), rank.end(), [&](const unsigned &a, const unsigned &b)
+                         { return doc_counts[a] > doc_counts[b]; });
+        std::vector<unsigned> rank_of(term_count);
+        for (unsigned r = 0; r < term_count; r++)
+            rank_of[rank[r]] = r;
+
+        std::vector<std::vector<unsigned>> signature(max_doc + 1);
+        for (unsigned d = 1; d <= max_doc; d++)
+        {
+            for (const unsigned &t : terms[d])
+            {
+                if (rank_of[t] < signature_terms)
+                    signature[d].push_back(rank_of[t]);
+            }
+            std::sort(signature[d].begin(), signature[d].end());
+        }
+
+        std::vector<unsigned> order(max_doc);
+        std::iota(order.begin(), order.end(), 1);
+        std::stable_sort(order.begin(), order.end(), [&](const unsigned &a, const unsigned &b)
+                         { return signature[a] < signature[b]; });
+
+        std::vector<unsigned> degree_a(term_count), degree_b(term_count);
+        split(order.begin(), order.end(), terms, degree_a, degree_b, iterations);
+
+        std::vector<unsigned> new_ID(max_doc + 1, 0);
+        for (unsigned i = 0; i < max_doc; i++)
+            new_ID[order[i]] = i + 1;
+        return new_ID;
+    }
+
+    // Renumbers every doc of every posting and keeps each posting sorted
+    static void apply(Trie &dictionary, const std::vector<unsigned> &new_ID)
+    {
+        dictionary.for_each([&](const std::string &, Posting *posting) { apply(posting, new_ID); });
+    }
+
+    // Renumbers one posting (e.g. one that is not in the dictionary)
+    static void apply(Posting *posting, const std::vector<unsigned> &new_ID)
+    {
+        std::vector<std::pair<unsigned, Document *>> docs;
+        for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next)
+            docs.emplace_back(doc->data.ID < new_ID.size() ? new_ID[doc->data.ID] : doc->data.ID, &doc->data);
+        std::sort(docs.begin(), docs.end(),
+                  [](const std::pair<unsigned, Document *> &a, const std::pair<unsigned, Document *> &b)
+                  { return a.first < b.first; });
+
+        List<Document> renumbered;
+        for (auto &doc : docs)
+        {
+            Document *copy = renumbered.push_back(Document(doc.first));
+            copy->term_freq = doc.second->term_freq;
+            copy->positions = doc.second->positions;
+            copy->positions_offset = doc.second->positions_offset;
+        }
+        posting->documents = renumbered;
+        posting->build_skips();
+        posting->prev_docID = docs.empty() ? INVALID_DOC_ID : docs.back().first;
+    }
+
+    static Stats measure(Trie &dictionary, const unsigned &frequent_terms = 16)
+    {
+        Stats stats;
+        std::vector<unsigned char> encoded;
+        std::vector<std::pair<unsigned, Posting *>> by_count;
+
+        dictionary.for_each([&](const std::string &, Posting *posting)
+        {
+            unsigned prev = 0;
+            for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next)
+            {
+                unsigned gap = doc->data.ID - prev;
+                prev = doc->data.ID;
+                stats.gamma_bits += 2 * unsigned(std::log2(gap)) + 1;
+                while (gap >= 128)
+                {
+                    encoded.push_back((gap & 127) | 128);
+                    gap >>= 7;
+                }
+                encoded.push_back(gap);
+                stats.postings++;
+            }
+            by_count.emplace_back(posting->doc_count, posting);
+        });
+        stats.gap_bytes = encoded.size();
+
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long checksum = 0;
+        unsigned value = 0, shift = 0;
+        for (const unsigned char &byte : encoded)
+        {
+            value |= (byte & 127u) << shift;
+            if (byte & 128)
+                shift += 7;
+            else
+            {
+                checksum += value;
+                value = shift = 0;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        stats.decode_ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+        const size_t top = std::min<size_t>(frequent_terms, by_count.size());
+        std::partial_sort(by_count.begin(), by_count.begin() + top, by_count.end(),
+                          [](const std::pair<unsigned, Posting *> &a, const std::pair<unsigned, Posting *> &b)
+                          { return a.first > b.first; });
+
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < top; i++)
+        {
+            for (size_t j = i + 1; j < top; j++)
+            {
+                std::vector<CursorPtr> children;
+                children.emplace_back(new TermCursor(by_count[i].second));
+                children.emplace_back(new TermCursor(by_count[j].second));
+                AndCursor both(std::move(children));
+                for (unsigned d = both.doc(); d != NO_MORE_DOCS; d = both.next())
+                    checksum += d;
+            }
+        }
+        end = std::chrono::steady_clock::now();
+        stats.intersect_ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+        volatile unsigned long long sink = checksum; // keeps the timed loops from being optimised out
+        (void)sink;
+        return stats;
+    }
+
+private:
+    using Iterator = std::vector<unsigned>::iterator;
+    const static unsigned signature_terms = 64; // frequent terms used by the initial sort
+
+    // Estimated bits to encode a term's gaps when it has degree docs among n
+    static double cost(const unsigned &degree, const size_t &n)
+    {
+        return degree * std::log2(double(n) / (degree + 1));
+    }
+
+    // Moves doc a to half B and doc b to half A if that lowers the cost
+    // Both term lists are sorted, so shared terms (which do not change) are skipped in one merge
+    static bool try_swap(const unsigned &a, const unsigned &b, const std::vector<std::vector<unsigned>> &terms,
+                         std::vector<unsigned> &degree_a, std::vector<unsigned> &degree_b,
+                         const size_t &n_a, const size_t &n_b)
+    {
+        const std::vector<unsigned> &ta = terms[a], &tb = terms[b];
+        double delta = 0;
+        size_t i = 0, j = 0;
+        while (i < ta.size() || j < tb.size())
+        {
+            if (j == tb.size() || (i < ta.size() && ta[i] < tb[j]))
+            {
+                const unsigned &t = ta[i++]; // only in a: moves from A to B
+                delta += cost(degree_a[t] - 1, n_a) + cost(degree_b[t] + 1, n_b)
+                       - cost(degree_a[t], n_a) - cost(degree_b[t], n_b);
+            }
+            else if (i == ta.size() || tb[j] < ta[i])
+            {
+                const unsigned &t = tb[j++]; // only in b: moves from B to A
+                delta += cost(degree_a[t] + 1, n_a) + cost(degree_b[t] - 1, n_b)
+                       - cost(degree_a[t], n_a) - cost(degree_b[t], n_b);
+            }
+            else
+            {
+                i++;
+                j++;
+            }
+        }
+        if (delta >= 0)
+            return false;
+
+        for (const unsigned &t : ta)
+        {
+            degree_a[t]--;
+            degree_b[t]++;
+        }
+        for (const unsigned &t : tb)
+        {
+            degree_b[t]--;
+            degree_a[t]++;
+        }
+        return true;
+    }
+
+    // Splits [begin, end) in two halves that share as few terms as possible,
+    // then recurses into each half
+    static void split(Iterator begin, Iterator end, const std::vector<std::vector<unsigned>> &terms,
+                      std::vector<unsigned> &degree_a, std::vector<unsigned> &degree_b,
+                      const unsigned &iterations)
+    {
+        const size_t n = end - begin;
+        if (n < 4)
+            return;
+        Iterator middle = begin + n / 2;
+        const size_t n_a = middle - begin, n_b = end - middle;
+
+        std::vector<std::pair<double, unsigned>> gain_a(n_a), gain_b(n_b);
+        for (unsigned it = 0; it < iterations; it++)
+        {
+            for (Iterator d = begin; d != end; d++)
+            {
+                for (const unsigned &t : terms[*d])
+                    degree_a[t] = degree_b[t] = 0;
+            }
+            for (Iterator d = begin; d != middle; d++)
+            {
+                for (const unsigned &t : terms[*d])
+                    degree_a[t]++;
+            }
+            for (Iterator d = middle; d != end; d++)
+            {
+                for (const unsigned &t : terms[*d])
+                    degree_b[t]++;
+            }
+
+            // Gain of moving each doc to the other half
+            for (size_t i = 0; i < n_a; i++)
+            {
+                double gain = 0;
+                for (const unsigned &t : terms[begin[i]])
+                    gain += cost(degree_a[t], n_a) + cost(degree_b[t], n_b)
+                          - cost(degree_a[t] - 1, n_a) - cost(degree_b[t] + 1, n_b);
+                gain_a[i] = {gain, begin[i]};
+            }
+            for (size_t i = 0; i < n_b; i++)
+            {
+                double gain = 0;
+                for (const unsigned &t : terms[middle[i]])
+                    gain += cost(degree_a[t], n_a) + cost(degree_b[t], n_b)
+                          - cost(degree_a[t] + 1, n_a) - cost(degree_b[t] - 1, n_b);
+                gain_b[i] = {gain, middle[i]};
+            }
+            std::sort(gain_a.begin(), gain_a.end(), std::greater<std::pair<double, unsigned>>());
+            std::sort(gain_b.begin(), gain_b.end(), std::greater<std::pair<double, unsigned>>());
+
+            for (size_t i = 0; i < n_a; i++)
+                begin[i] = gain_a[i].second;
+            for (size_t i = 0; i < n_b; i++)
+                middle[i] = gain_b[i].second;
+
+            // Try the most promising pairs first, but only keep a swap if it
+            // really lowers the cost given the swaps already made
+            // (docs with the same terms have the same gain and would otherwise all swap at once)
+            size_t swaps = 0;
+            for (size_t i = 0; i < n_a && i < n_b && gain_a[i].first + gain_b[i].first > 0; i++)
+            {
+                if (try_swap(begin[i], middle[i], terms, degree_a, degree_b, n_a, n_b))
+                {
+                    std::swap(begin[i], middle[i]);
+                    swaps++;
+                }
+            }
+            if (swaps == 0)
+                break;
+        }
+
+        split(begin, middle, terms, degree_a, degree_b, iterations);
+        split(middle, end, terms, degree_a, degree_b, iterations);
+    }
+};
+
+#endif
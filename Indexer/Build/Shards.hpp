@@ -0,0 +1,113 @@
+#pragma once
+#ifndef SHARDS_HPP
+#define SHARDS_HPP
+
+#include "../Tries/Trie.hpp"
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Document-partitioned shards of an index
+// Shard i holds every term's postings for the docs first..last of a contiguous range,
+// so after reordering similar docs also share a shard
+// Doc IDs are not renumbered: a shard answers with the same IDs the whole index would
+class Shards
+{
+public:
+    struct Range
+    {
+        std::string filename;
+        unsigned first{1};
+        unsigned last{0};
+    };
+
+    // Splits 1..max_doc into count ranges holding about the same number of postings
+    static std::vector<Range> partition(Trie &dictionary, const unsigned &max_doc, const unsigned &count)
+    {
+        std::vector<unsigned long long> load(max_doc + 1, 0);
+        unsigned long long total = 0;
+        dictionary.for_each([&](const std::string &, Posting *posting)
+        {
+            for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next)
+            {
+                if (doc->data.ID <= max_doc)
+                {
+                    load[doc->data.ID]++;
+                    total++;
+                }
+            }
+        });
+
+        std::vector<Range> ranges;
+        unsigned long long seen = 0;
+        unsigned first = 1;
+        for (unsigned ID = 1; ID <= max_doc; ID++)
+        {
+            seen += load[ID];
+            // Close a range once it reaches its share, leaving a doc for every range still to come
+            const unsigned left = count - ranges.size();
+            if (left > 1 && (seen * count >= total * (ranges.size() + 1) || max_doc - ID < left))
+            {
+                ranges.push_back(Range{"", first, ID});
+                first = ID + 1;
+            }
+        }
+        if (first <= max_doc)
+            ranges.push_back(Range{"", first, max_doc});
+        for (unsigned i = 0; i < ranges.size(); i++)
+            ranges[i].filename = "shard" + std::to_string(i + 1) + ".txt";
+        return ranges;
+    }
+
+    // Writes every shard in the index.txt format and a manifest listing
+    // "filename first last" per shard
+    static void write(Trie &dictionary, const std::vector<Range> &ranges, const char *manifest_name)
+    {
+        std::ofstream manifest(manifest_name);
+        for (const Range &range : ranges)
+        {
+            std::ofstream file(range.filename);
+            write_range(dictionary, range, file);
+            manifest << range.filename << " " << range.first << " " << range.last << "\n";
+        }
+    }
+
+    // Returns an empty list if the manifest cannot be read
+    static std::vector<Range> read_manifest(const char *manifest_name)
+    {
+        std::vector<Range> ranges;
+        std::ifstream manifest(manifest_name);
+        Range range;
+        while (manifest >> range.filename >> range.first >> range.last)
+            ranges.push_back(range);
+        return ranges;
+    }
+
+private:
+    // Terms with no doc in the range are left out
+    static void write_range(Trie &dictionary, const Range &range, std::ostream &file)
+    {
+        dictionary.for_each([&](const std::string &term, Posting *posting)
+        {
+            unsigned doc_count = 0;
+            for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next)
+                doc_count += doc->data.ID >= range.first && doc->data.ID <= range.last;
+            if (doc_count == 0)
+                return;
+
+            file << term << " " << doc_count << " ";
+            for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next)
+            {
+                if (doc->data.ID < range.first || doc->data.ID > range.last)
+                    continue;
+                file << doc->data.ID << " " << doc->data.term_freq;
+                for (auto pos = doc->data.positions.begin(); pos != nullptr; pos = pos->next)
+                    file << " " << pos->data;
+                file << " ";
+            }
+            file << "\n";
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// A fixed-size lock-free queue for any number of producers and consumers
+// (D. Vyukov's bounded MPMC queue: every cell carries a sequence number
+// that says whether it is ready to be written or read in the current lap)
+// A full queue makes producers wait and an empty one makes consumers wait,
+// so a fast stage can never run more than capacity items ahead of a slow one
+template <typename type>
+class BoundedQueue
+{
+public:
+    // capacity is rounded up to a power of 2
+    BoundedQueue(const size_t &capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        mask = size - 1;
+        cells.reset(new Cell[size]);
+        for (size_t i = 0; i < size; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    // Returns false if the queue is full
+    bool try_push(type &item)
+    {
+        size_t at = tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells[at & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == at)
+            {
+                if (tail.compare_exchange_weak(at, at + 1, std::memory_order_relaxed))
+                {
+                    cell.data = std::move(item);
+                    cell.sequence.store(at + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < at)
+                return false; // the cell still holds last lap's item
+            else
+                at = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the queue is empty
+    bool try_pop(type &item)
+    {
+        size_t at = head.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells[at & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == at + 1)
+            {
+                if (head.compare_exchange_weak(at, at + 1, std::memory_order_relaxed))
+                {
+                    item = std::move(cell.data);
+                    cell.sequence.store(at + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < at + 1)
+                return false; // nothing written here yet
+            else
+                at = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    // Waits for room; returns true if it had to wait
+    bool push(type item)
+    {
+        if (try_push(item))
+            return false;
+        while (!try_push(item))
+            std::this_thread::yield();
+        return true;
+    }
+
+    // Waits for an item; returns false once the queue is closed and drained
+    bool pop(type &item)
+    {
+        while (!try_pop(item))
+        {
+            if (closed.load(std::memory_order_acquire))
+                return try_pop(item); // an item pushed just before close()
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    // No more pushes will follow
+    void close()
+    {
+        closed.store(true, std::memory_order_release);
+    }
+
+    // Items waiting at this moment (approximate while others push and pop)
+    size_t depth() const
+    {
+        const size_t pushed = tail.load(std::memory_order_relaxed);
+        const size_t popped = head.load(std::memory_order_relaxed);
+        return pushed > popped ? pushed - popped : 0;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        type data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask{0};
+    alignas(64) std::atomic<size_t> tail{0}; // next cell to write
+    alignas(64) std::atomic<size_t> head{0}; // next cell to read
+    std::atomic<bool> closed{false};
+};
+
+#endif
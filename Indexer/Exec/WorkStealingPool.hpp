@@ -0,0 +1,142 @@
+#pragma once
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads, each with its own deque of tasks
+// A worker takes its newest task first and, once it runs dry, steals the
+// oldest task of another worker, so uneven tasks still keep every core busy
+class WorkStealingPool
+{
+public:
+    // threads = 0 uses one thread per core
+    WorkStealingPool(unsigned threads = 0)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < threads; i++)
+            queues.emplace_back(new Queue);
+        for (unsigned i = 0; i < threads; i++)
+            workers.emplace_back([this, i]() { work(i); });
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    unsigned size() const
+    {
+        return workers.size();
+    }
+
+    // Runs task(0) .. task(n - 1) and returns once all of them are done
+    // The calling thread runs tasks too while it waits
+    // Safe to call from several threads at once, and from inside a task
+    void parallel_for(const size_t &n, const std::function<void(size_t)> &task)
+    {
+        std::atomic<size_t> left{n};
+        for (size_t i = 0; i < n; i++)
+            push(i % queues.size(), [&task, &left, i]()
+            {
+                task(i);
+                left--;
+            });
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock); // no worker is between its check and its wait
+        }
+        wake.notify_all();
+
+        size_t from = 0;
+        while (left)
+        {
+            if (!run_one(from++ % queues.size()))
+                std::this_thread::yield(); // the rest are running elsewhere
+        }
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // queues[i] belongs to workers[i]
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued{0};
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    bool stopping{false};
+
+    void push(const size_t &i, std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> guard(queues[i]->lock);
+            queues[i]->tasks.push_back(std::move(task));
+        }
+        queued++;
+    }
+
+    // Pops the newest task of queue self or else steals the oldest of another queue
+    // Returns false if every queue is empty
+    bool run_one(const size_t &self)
+    {
+        std::function<void()> task;
+        for (size_t k = 0; k < queues.size() && !task; k++)
+        {
+            Queue &queue = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.tasks.empty())
+                continue;
+            if (k == 0)
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+        if (!task)
+            return false;
+        queued--;
+        task();
+        return true;
+    }
+
+    void work(const size_t &self)
+    {
+        while (true)
+        {
+            if (run_one(self))
+                continue;
+            std::unique_lock<std::mutex> guard(sleep_lock);
+            wake.wait(guard, [this]() { return stopping || queued > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+#endif
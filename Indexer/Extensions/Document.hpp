@@ -10,6 +10,7 @@ struct Document
     const unsigned ID; // Doc ID
     unsigned term_freq{0}; // freq of term in doc
     List<unsigned> positions; // The positions at which the term appears
+    unsigned long long positions_offset{0}; // Where the positions start in a positions file (if not loaded)
 
     // Constructors
     Document()
@@ -25,7 +26,8 @@ struct Document
     }
 
     Document(const Document &other)
-        : ID(other.ID), term_freq(other.term_freq), positions(other.positions) {}
+        : ID(other.ID), term_freq(other.term_freq), positions(other.positions),
+          positions_offset(other.positions_offset) {}
 
     Document &operator=(const Document &other)
     {
@@ -34,6 +36,7 @@ struct Document
 
         this->term_freq = other.term_freq;
         this->positions = other.positions;
+        this->positions_offset = other.positions_offset;
         return *this;
     }
 
@@ -44,6 +47,12 @@ struct Document
         positions.push_back(pos);
     }
 
+    // True if the positions live in a positions file instead of memory
+    bool positions_on_disk() const
+    {
+        return term_freq && positions.empty();
+    }
+
     bool operator==(const Document &other) const
     {
         return this->ID == other.ID;
@@ -2,6 +2,8 @@
 #ifndef LIST_HPP
 #define LIST_HPP
 
+#include "Publish.hpp"
+
 // a general template structure for node of a singly linked list
 template <typename type>
 struct Node
@@ -88,12 +90,13 @@ public:
         Node<type> *newnode = new Node<type>(data, nullptr);
         if (head == nullptr)
         { // insert directly:
-            head = tail = newnode;
+            publish(head, newnode);
+            tail = newnode;
         }
         else
-        { // insert at tail:
-            tail->next = newnode;
-            tail = tail->next;
+        { // insert at tail (readers may be walking the list):
+            publish(tail->next, newnode);
+            tail = newnode;
         }
         return &(newnode->data);
     }
@@ -3,6 +3,11 @@
 #define POSTING_HPP
 
 #include "Document.hpp"
+#include "Publish.hpp"
+
+#define SKIP_INTERVAL (16)
+
+struct DiskRun;
 
 struct Posting
 {
@@ -10,6 +15,8 @@ struct Posting
     unsigned total_count{0}; // The total number of times the term appears
     unsigned prev_docID = INVALID_DOC_ID;
     List<Document> documents; // List of docs in which term appears
+    AppendOnlyArray<Node<Document> *> skips; // Every SKIP_INTERVAL-th doc node, so cursors can jump ahead
+    const DiskRun *disk{0}; // set instead of documents if the docs are in a block file (see Storage/DiskPostings.hpp)
 
     // Constructors
     Posting() = default;
@@ -20,7 +27,10 @@ struct Posting
     }
 
     Posting(const Posting &other)
-        : documents(other.documents), doc_count(other.doc_count) {}
+        : documents(other.documents), doc_count(other.doc_count)
+    {
+        build_skips();
+    }
 
     Posting &operator=(const Posting &other)
     {
@@ -29,9 +39,23 @@ struct Posting
 
         this->doc_count = other.doc_count;
         this->documents = other.documents;
+        build_skips();
         return *this;
     }
 
+    // Skips are kept up to date while docs are appended
+    // Call this after the doc list was replaced or reordered
+    void build_skips()
+    {
+        skips.clear();
+        unsigned i = 0;
+        for (auto doc = documents.begin(); doc != nullptr; doc = doc->next, i++)
+        {
+            if (i && i % SKIP_INTERVAL == 0)
+                skips.push_back(doc);
+        }
+    }
+
     // Add a new position of the term in the doc or a new doc all together
     void push_directly(const unsigned &doc_ID, const unsigned &pos)
     {
@@ -41,10 +65,31 @@ struct Posting
         else
         {
             prev_docID = doc_ID;
-            doc_count++;
             documents.push_back(Document(doc_ID, pos));
+            publish(doc_count, doc_count + 1);
+            add_skip();
         }
     }
+
+    // Add a whole doc whose positions are kept in a positions file
+    void push_document(const unsigned &doc_ID, const unsigned &term_freq, const unsigned long long &offset)
+    {
+        total_count += term_freq;
+        prev_docID = doc_ID;
+        Document *doc = documents.push_back(Document(doc_ID));
+        doc->term_freq = term_freq;
+        doc->positions_offset = offset;
+        publish(doc_count, doc_count + 1);
+        add_skip();
+    }
+
+private:
+    // Called right after a doc was appended
+    void add_skip()
+    {
+        if (doc_count > 1 && (doc_count - 1) % SKIP_INTERVAL == 0)
+            skips.push_back(documents.last());
+    }
 };
 
 #endif
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef PUBLISH_HPP
+#define PUBLISH_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// One writer, many readers, no locks
+// The writer fills in an object completely and only then publishes the pointer
+// (or flag, or count) that leads to it; a reader that observes the new value
+// also observes everything the writer did before publishing it
+// Fields that are published stay plain types so that code which never runs
+// next to a writer (loading, writing, reordering) is unchanged
+
+template <typename type>
+inline void publish(type &field, const type &value)
+{
+    __atomic_store_n(&field, value, __ATOMIC_RELEASE);
+}
+
+template <typename type>
+inline type observe(const type &field)
+{
+    return __atomic_load_n(&field, __ATOMIC_ACQUIRE);
+}
+
+// An array that one thread appends to while others read it
+// Growing copies the items into a bigger block and keeps the old block alive
+// until clear() or destruction, so a reader never loses the block it is reading
+// (old blocks add up to less than the current one)
+template <typename type>
+class AppendOnlyArray
+{
+public:
+    AppendOnlyArray() = default;
+    AppendOnlyArray(const AppendOnlyArray &) = delete;
+    AppendOnlyArray &operator=(const AppendOnlyArray &) = delete;
+
+    // Writer only
+    void push_back(const type &item)
+    {
+        if (count == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 4;
+            std::unique_ptr<type[]> bigger(new type[capacity]);
+            for (size_t i = 0; i < count; i++)
+                bigger[i] = items[i];
+            publish(items, bigger.get());
+            blocks.push_back(std::move(bigger));
+        }
+        items[count] = item;
+        publish(count, count + 1);
+    }
+
+    // Not safe while anyone reads the array
+    void clear()
+    {
+        blocks.clear();
+        items = nullptr;
+        count = capacity = 0;
+    }
+
+    // Readers take size() before data(): the block they then see holds at least that many items
+    size_t size() const { return observe(count); }
+    const type *data() const { return observe(items); }
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (size_t i = 0, block = capacity; i < blocks.size(); i++, block /= 2)
+            total += block * sizeof(type);
+        return total;
+    }
+
+private:
+    type *items{0};
+    size_t count{0};
+    size_t capacity{0};
+    std::vector<std::unique_ptr<type[]>> blocks; // blocks.back() is items
+};
+
+#endif
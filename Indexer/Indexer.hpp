@@ -2,14 +2,37 @@
 #ifndef INDEXER_HPP
 #define INDEXER_HPP
 #define TOTAL_DOCS (30)
+#define BLOCK_CACHE_BYTES (64ull << 20) // for a disk-resident index without a memory budget
 
 #include "Tries/Trie.hpp"
+#include "Query/Cursor.hpp"
+#include "Query/Planner.hpp"
+#include "Query/Budget.hpp"
+#include "Query/Partition.hpp"
+#include "Query/Paging.hpp"
+#include "Query/Fuzzy.hpp"
+#include "Exec/WorkStealingPool.hpp"
+#include "Storage/PositionsFile.hpp"
+#include "Storage/TextLoader.hpp"
+#include "Storage/ForwardStore.hpp"
+#include "Build/Reorder.hpp"
+#include "Build/Biwords.hpp"
+#include "Build/Shards.hpp"
+#include "Build/Pipeline.hpp"
+#include "Stats/Memory.hpp"
+#include "Stats/TermLog.hpp"
 #include <cmath>
 #include <fstream>
 #include <algorithm>
 #include <string>
 #include <vector>
 #include <map>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <set>
+#include <deque>
+#include <unordered_map>
 
 class Indexer
 {
@@ -21,6 +44,53 @@ private:
     HashEntry *target{0};
 
     Trie dictionary;
+    PositionsFile positions_file; // used when positions are not loaded into memory
+    std::vector<unsigned> external_IDs; // external_IDs[ID] is the doc's original ID; empty if not reordered
+    MemoryBudget budget;                // limits what read(), read_parallel() and read_split() may load
+    bool positions_skipped{false};      // true if the budget forced a load without positions
+    unsigned first_doc{1};              // docs this index answers for; a shard only holds a range
+    unsigned last_doc{0};               // the highest doc loaded, and the watermark index() raises once a new doc is complete
+    std::unique_ptr<WorkStealingPool> query_pool; // evaluates large queries in parts; null means one thread
+    unsigned long long parallel_min_work{1 << 15}; // postings a query needs before it is split
+    Biwords biwords;                    // frequent word pairs, for phrase queries
+    bool collecting_biwords{false};     // true between collect_biwords() and build_biwords()
+    unsigned pair_next{0};              // position right after the last word index() kept
+    std::string pair_first;             // that word
+    PhraseSupport phrase_support;       // what the planner uses to answer phrases
+    ForwardStore::Builder forward;      // the docs' text, between collect_text() and write_forward()
+    bool collecting_text{false};
+    ForwardStore forward_store;         // the docs' text for text() and snippet()
+    std::unique_ptr<BlockCache> block_cache; // reads postings and positions of a disk-resident index
+    std::deque<DiskRun> disk_runs;      // where each term's docs are in its block file
+    BudgetCounters budget_counters;     // how the queries given a budget went
+    TermLog *term_log{0};               // counts the terms of the queries answered, if set
+
+    // Reads a cursor's docs into result until they end or the budget is spent
+    // A doc found once the budget is spent may have come from a list cut short, so it is dropped
+    static void drain(const CursorPtr &root, QueryBudget *budget, std::vector<unsigned> &result)
+    {
+        for (unsigned d = root->doc(); d != NO_MORE_DOCS; d = root->next())
+        {
+            if (budget && budget->charge(1))
+                break;
+            result.push_back(d);
+        }
+    }
+
+    void log_terms(const std::vector<std::string> &query)
+    {
+        if (term_log)
+            term_log->record(query);
+    }
+
+    // Counts a query that had a budget; true if it went over and must fail
+    bool over_budget(QueryBudget *budget)
+    {
+        if (!budget)
+            return false;
+        budget_counters.record(*budget);
+        return budget->exceeded() && budget->policy == QueryBudget::ABORT;
+    }
 
     bool binary_search(std::vector<std::string>::iterator it, const int size, const std::string& s)
     {
@@ -124,26 +194,158 @@ private:
         return word;
     }
 
+    // Whether a word is indexed; a kept word is stemmed in place
+    bool keep_word(std::string &word)
+    {
+        if (is_stopword(word))
+            return false;
+        stem(word);
+        return true;
+    }
+
+    // Adds the word index() just kept to the posting of the pair it ends,
+    // if the word before it was kept too
+    void pair_up(const std::string &word, const unsigned &doc_ID)
+    {
+        if (pos == pair_next && pos > 0)
+            biwords.add(pair_first, word, doc_ID, pos - 1);
+        pair_first = word;
+        pair_next = pos + 1;
+    }
+
     bool is_operator(const std::string& s)
     {
         return s == "not" || s == "and" || s == "or";
     }
 
+    // Runs load(true); if that breaks the budget and the policy allows it,
+    // runs load(false) so that only doc-level postings are kept
+    template <typename Loader>
+    bool within_budget(Loader load)
+    {
+        budget.reset();
+        positions_skipped = false;
+        publish(last_doc, 0u);
+        if (load(true))
+            return loaded(highest_doc());
+
+        if (budget.policy == MemoryBudget::SKIP_POSITIONS)
+        {
+            budget.reset();
+            positions_skipped = true;
+            if (load(false))
+                return loaded(highest_doc());
+        }
+        dictionary.deleteTrie();
+        return false;
+    }
+
+    // The highest doc ID in the postings held in memory
+    unsigned highest_doc()
+    {
+        unsigned highest = 0;
+        dictionary.for_each([&](const std::string &, Posting *posting)
+        {
+            if (posting->documents.last())
+                highest = std::max(highest, posting->documents.last()->data.ID);
+        });
+        return highest;
+    }
+
+    // Lets queries see the docs of an index just read, up to last
+    bool loaded(const unsigned &last)
+    {
+        publish(last_doc, last);
+        return true;
+    }
+
+    // Reads an index written by write_on()
+    // Returns false as soon as the memory budget is exceeded
+    bool read_util(const char *filename, const bool &with_positions)
+    {
+        std::string token;
+        unsigned doc_count{0};
+        unsigned doc_ID{0};
+        unsigned term_freq{0};
+        unsigned pos{0};
+        unsigned long long tables{0};
+        HashEntry *target;
+
+        dictionary.deleteTrie();
+        positions_file.attach("");
+
+        std::ifstream file;
+        file.open(filename, std::ios::in);
+        while (!file.eof())
+        {
+            file >> token;
+            if (file.eof())
+                break;
+
+            file >> doc_count;
+            if (file.eof())
+                break;
+
+            tables = dictionary.table_count();
+            target = dictionary.insert(token); // once per term, not once per position
+            if (!target->posting)
+                target->posting = new Posting;
+            if (!budget.charge((dictionary.table_count() - tables) * sizeof(HashTable) + sizeof(Posting)))
+                return false;
+
+            for (unsigned i = 0; i < doc_count; i++)
+            {
+                file >> doc_ID;
+                if (file.eof())
+                    break;
+                file >> term_freq;
+                if (file.eof())
+                    break;
+
+                if (!budget.charge(sizeof(Node<Document>)
+                                   + (with_positions ? term_freq * sizeof(Node<unsigned>) : 0)))
+                    return false;
+                if (!with_positions)
+                    target->posting->push_document(doc_ID, term_freq, 0);
+
+                for (unsigned j = 0; j < term_freq; j++)
+                {
+                    file >> pos;
+                    if (file.eof())
+                        break;
+
+                    if (with_positions)
+                        target->posting->push_directly(doc_ID, pos);
+                }
+            }
+        }
+        file.close();
+        return true;
+    }
+
 public:
 
     // Constructor
     Indexer()
     {
         load_stopwords();
+        phrase_support.keep = [this](std::string &word) { return keep_word(word); };
+        phrase_support.positions = &positions_file;
     }
 
+    // Adds a doc; queries may run on other threads meanwhile (one thread indexes at a time)
+    // A doc with an ID above the last doc is invisible to them until it is fully indexed,
+    // so docs indexed in increasing ID order appear one by one (near-real-time search)
     void index(const char *filename, const unsigned &doc_ID = 0)
     {
-        std::string word;
+        std::string word, text;
         pos = 0;
+        pair_next = 0;
         FILE *file = fopen(filename, "r");
         while ((c1 = fgetc(file)) != EOF)
         {
+            if (collecting_text)
+                text.push_back(c1);
             if ((c1 >= 'a' && c1 <= 'z') || (c1 >= '0' && c1 <= '9'))
                 word.push_back(c1);
             else if (c1 >= 'A' && c1 <= 'Z')
@@ -159,7 +361,9 @@ public:
                     if (target->posting)
                         target->posting->push_directly(doc_ID, pos);
                     else
-                        target->posting = new Posting(doc_ID, pos);
+                        publish(target->posting, new Posting(doc_ID, pos));
+                    if (collecting_biwords)
+                        pair_up(word, doc_ID);
                 }
                 word.clear();
                 pos++;
@@ -172,9 +376,64 @@ public:
             if (target->posting)
                 target->posting->push_directly(doc_ID, pos);
             else
-                target->posting = new Posting(doc_ID, pos);
+                publish(target->posting, new Posting(doc_ID, pos));
+            if (collecting_biwords)
+                pair_up(word, doc_ID);
         }
         fclose(file);
+        if (collecting_text)
+            forward.add(doc_ID, external_ID(doc_ID), filename, text);
+
+        // Only now may queries see the doc
+        if (doc_ID > last_doc)
+            publish(last_doc, doc_ID);
+    }
+
+    // Indexes many docs, given as (filename, doc ID), through a read -> tokenize -> invert
+    // pipeline (see Build/Pipeline.hpp); tokenizers = 0 uses the spare cores
+    // source says how the files are read (see Storage/FileSource.hpp)
+    // Gives the same index as index() on every file in turn, and docs become visible to
+    // queries one by one just as they do with index()
+    Pipeline::Stats index_files(const std::vector<std::pair<std::string, unsigned>> &files,
+                                const unsigned &tokenizers = 0,
+                                const FileSource::Method &source = FileSource::AUTO)
+    {
+        return Pipeline::run(files,
+                             [this](std::string &word) { return keep_word(word); },
+                             [&](Pipeline::Terms &doc)
+                             {
+                                 if (collecting_text)
+                                     forward.add(doc.ID, external_ID(doc.ID), files[doc.sequence].first, doc.text);
+                                 invert(doc);
+                             },
+                             tokenizers, 64, source, collecting_text);
+    }
+
+    // Adds a tokenized doc with one dictionary lookup per term
+    void invert(Pipeline::Terms &doc)
+    {
+        for (auto &term : doc.terms)
+        {
+            HashEntry *entry = dictionary.insert(term.first);
+            auto pos = term.second.begin();
+            if (!entry->posting)
+                publish(entry->posting, new Posting(doc.ID, *pos++));
+            for (; pos != term.second.end(); ++pos)
+                entry->posting->push_directly(doc.ID, *pos);
+        }
+        if (collecting_biwords)
+        {
+            std::vector<std::pair<unsigned, const std::string *>> words; // (position, word)
+            for (const auto &term : doc.terms)
+                for (const auto &pos : term.second)
+                    words.emplace_back(pos, &term.first);
+            std::sort(words.begin(), words.end());
+            for (size_t i = 1; i < words.size(); i++)
+                if (words[i].first == words[i - 1].first + 1)
+                    biwords.add(*words[i - 1].second, *words[i].second, doc.ID, words[i - 1].first);
+        }
+        if (doc.ID > last_doc)
+            publish(last_doc, doc.ID);
     }
 
     void write_on(const char *filename)
@@ -185,210 +444,950 @@ public:
         file.close();
     }
 
-    void read(const char *filename)
+    // Returns false if the index does not fit in the memory budget
+    bool read(const char *filename)
+    {
+        return within_budget([&](const bool &with_positions)
+                             { return read_util(filename, with_positions); });
+    }
+
+    // Same as read() but parses the file on several threads
+    // threads = 0 uses one thread per core
+    bool read_parallel(const char *filename, const unsigned &threads = 0)
+    {
+        return within_budget([&](const bool &with_positions)
+        {
+            dictionary.deleteTrie();
+            positions_file.attach("");
+            return TextLoader::load(filename, dictionary, threads, &budget, with_positions);
+        });
+    }
+
+    // Writes doc-level postings and positions into separate files
+    // Positions must be in memory (built by index() or loaded by read())
+    void write_split(const char *postings_name, const char *positions_name)
+    {
+        std::ofstream postings, positions;
+        postings.open(postings_name, std::ios::out);
+        positions.open(positions_name, std::ios::out | std::ios::binary);
+        dictionary.write_split(postings, positions);
+        positions.close();
+        postings.close();
+    }
+
+    // Loads only doc IDs and term frequencies
+    // Positions stay in positions_name until positions() needs them
+    // Returns false if either file cannot be read or the doc-level postings do not fit
+    // in the memory budget
+    bool read_split(const char *postings_name, const char *positions_name)
     {
         std::string token;
         unsigned doc_count{0};
         unsigned doc_ID{0};
         unsigned term_freq{0};
-        unsigned pos{0};
+        unsigned long long offset{0};
         HashEntry *target;
 
         dictionary.deleteTrie();
+        publish(last_doc, 0u);
+        if (!positions_file.attach(positions_name))
+            return false;
 
         std::ifstream file;
-        file.open(filename, std::ios::in);
-        while (!file.eof())
+        file.open(postings_name, std::ios::in);
+        if (!file)
+            return false;
+        budget.reset();
+        positions_skipped = false;
+        while (file >> token >> doc_count >> offset)
         {
-            file >> token;
-            if (file.eof())
-                break;
-
-            file >> doc_count;
-            if (file.eof())
-                break;
+            unsigned long long tables = dictionary.table_count();
+            target = dictionary.insert(token);
+            if (!target->posting)
+                target->posting = new Posting;
+            if (!budget.charge((dictionary.table_count() - tables) * sizeof(HashTable) + sizeof(Posting)
+                               + doc_count * sizeof(Node<Document>)))
+            {
+                dictionary.deleteTrie();
+                return false;
+            }
 
             for (unsigned i = 0; i < doc_count; i++)
             {
-                file >> doc_ID;
-                if (file.eof())
-                    break;
-                file >> term_freq;
-                if (file.eof())
+                if (!(file >> doc_ID >> term_freq))
                     break;
+                target->posting->push_document(doc_ID, term_freq, offset);
+                offset += term_freq;
+            }
+        }
+        file.close();
+        return loaded(highest_doc());
+    }
 
-                for (unsigned j = 0; j < term_freq; j++)
-                {
-                    file >> pos;
-                    if (file.eof())
-                        break;
+    // Writes doc-level postings as a block file of (doc ID, term freq) pairs and a
+    // dictionary naming where each term's pairs and positions start, for read_blocks()
+    // Positions are those write_split() writes, which walks the terms in the same order
+    void write_blocks(const char *terms_name, const char *blocks_name)
+    {
+        std::ofstream terms, blocks;
+        terms.open(terms_name, std::ios::out);
+        blocks.open(blocks_name, std::ios::out | std::ios::binary);
+        unsigned long long entry = 0, offset = 0; // counted in pairs and positions
+        terms << "#last_doc " << highest_doc() << "\n"; // no term starts with '#'
+        dictionary.for_each([&](const std::string &term, Posting *posting)
+        {
+            terms << term << " " << posting->doc_count << " " << entry << " " << offset << " "
+                  << (posting->doc_count ? (posting->doc_count - 1) / DISK_SKIP : 0);
+            unsigned i = 0;
+            for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next, i++)
+            {
+                if (i && i % DISK_SKIP == 0)
+                    terms << " " << doc->data.ID << " " << offset;
+                const unsigned pair[2] = {doc->data.ID, doc->data.term_freq};
+                blocks.write(reinterpret_cast<const char *>(pair), sizeof(pair));
+                offset += doc->data.term_freq;
+                entry++;
+            }
+            terms << "\n";
+        });
+        blocks.close();
+        terms.close();
+    }
 
-                    target = dictionary.insert(token);
-                    if (target->posting)
-                        target->posting->push_directly(doc_ID, pos);
-                    else
-                        target->posting = new Posting(doc_ID, pos);
-                }
+    // Loads only the dictionary of a disk-resident index written by write_blocks():
+    // postings and positions are read block by block as queries need them, through a
+    // cache that gets whatever the memory budget leaves (BLOCK_CACHE_BYTES without one)
+    // Returns false if the dictionary does not fit in the memory budget or a file is missing
+    bool read_blocks(const char *terms_name, const char *blocks_name, const char *positions_name)
+    {
+        std::string token;
+        unsigned doc_count{0};
+        unsigned long long entry{0};
+        unsigned long long offset{0};
+        size_t skip_count{0};
+        HashEntry *target;
+
+        positions_file.attach("");
+        dictionary.deleteTrie();
+        disk_runs.clear();
+        block_cache.reset();
+        publish(last_doc, 0u);
+
+        std::ifstream file;
+        file.open(terms_name, std::ios::in);
+        if (!file)
+            return false;
+        budget.reset();
+        positions_skipped = false;
+        const bool known_last = file.peek() == '#'; // files written before the line was added lack it
+        unsigned last{0};
+        if (known_last && !(file >> token >> last))
+            return false;
+        while (file >> token >> doc_count >> entry >> offset >> skip_count)
+        {
+            disk_runs.emplace_back();
+            DiskRun &run = disk_runs.back();
+            run.entry = entry;
+            run.positions = offset;
+            run.skips.resize(skip_count);
+            for (auto &skip : run.skips)
+                file >> skip.first >> skip.second;
+
+            unsigned long long tables = dictionary.table_count();
+            target = dictionary.insert(token);
+            if (!target->posting)
+                target->posting = new Posting;
+            target->posting->doc_count = doc_count;
+            target->posting->disk = &run;
+            if (!budget.charge((dictionary.table_count() - tables) * sizeof(HashTable) + sizeof(Posting)
+                               + sizeof(DiskRun) + skip_count * sizeof(run.skips[0])))
+            {
+                dictionary.deleteTrie();
+                disk_runs.clear();
+                return false;
+            }
+        }
+        file.close();
+
+        block_cache.reset(new BlockCache(budget.limited() ? budget.limit - budget.charged() : BLOCK_CACHE_BYTES));
+        const int blocks = block_cache->add_file(blocks_name);
+        if (blocks < 0)
+        {
+            dictionary.deleteTrie();
+            disk_runs.clear();
+            return false;
+        }
+        for (auto &run : disk_runs)
+        {
+            run.cache = block_cache.get();
+            run.file = blocks;
+        }
+        positions_file.attach(positions_name, block_cache.get());
+        return loaded(known_last ? last : highest_block_doc(blocks_name));
+    }
+
+    // The highest doc ID in a block file, found by reading all of it
+    static unsigned highest_block_doc(const char *blocks_name)
+    {
+        std::ifstream blocks;
+        blocks.open(blocks_name, std::ios::in | std::ios::binary);
+        unsigned highest = 0;
+        unsigned pairs[2 * 1024];
+        while (blocks.read(reinterpret_cast<char *>(pairs), sizeof(pairs)) || blocks.gcount())
+        {
+            for (std::streamsize i = 0; i + 1 < blocks.gcount() / std::streamsize(sizeof(unsigned)); i += 2)
+                highest = std::max(highest, pairs[i]);
+        }
+        return highest;
+    }
+
+    // Hits, misses and evictions of the block cache of a disk-resident index
+    BlockCache::Stats cache_stats() const
+    {
+        return block_cache ? block_cache->stats() : BlockCache::Stats();
+    }
+
+    // Makes every query this index answers count its terms into log, which must outlive
+    // the index (see Stats/TermLog.hpp); nullptr stops it
+    void set_term_log(TermLog *log)
+    {
+        term_log = log;
+    }
+
+    // Reads in what the terms asked for most in log will need, most asked for first,
+    // until max_bytes are read or max_ms have passed, so the first queries after a
+    // restart or reload do not wait on the disk: for a disk-resident index their posting
+    // blocks and then their positions go into the block cache (only as many as it holds
+    // without pushing out what was read before), and for an index read with read_split()
+    // the kernel is asked to read their positions into the page cache
+    // The dictionary and postings read into memory are already there
+    // Call it after the index is read, before queries run
+    TermLog::Warmed warm_up(const TermLog &log, const unsigned long long &max_bytes, const unsigned &max_ms)
+    {
+        TermLog::Warmed warmed;
+        const auto start = std::chrono::steady_clock::now();
+        auto out_of_time = [&]()
+        {
+            return std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(max_ms);
+        };
+        const unsigned long long limit = block_cache ? std::min<unsigned long long>(max_bytes, block_cache->warm_capacity())
+                                                     : max_bytes;
+
+        std::vector<const Posting *> hot;
+        for (const auto &term : log.top(log.size()))
+        {
+            HashEntry *h = dictionary.search(term.first);
+            const Posting *posting = h ? observe(h->posting) : nullptr;
+            if (posting && observe(posting->doc_count))
+                hot.push_back(posting);
+        }
+
+        // Postings first, as every query needs them and only phrases need positions
+        for (size_t i = 0; i < hot.size() && hot[i]->disk && warmed.bytes < limit && !out_of_time(); i++)
+        {
+            const DiskRun &run = *hot[i]->disk;
+            const size_t block = block_cache->block_size();
+            const unsigned long long begin = run.entry * 2 * sizeof(unsigned);
+            const unsigned long long end = (run.entry + hot[i]->doc_count) * 2 * sizeof(unsigned);
+            for (unsigned long long b = begin / block; b * block < end && warmed.bytes < limit; b++)
+                warmed.bytes += block_cache->warm(run.file, b);
+            warmed.terms++;
+        }
+
+        // A term's positions end where the next term's begin
+        std::unordered_map<const DiskRun *, unsigned long long> positions_end;
+        for (size_t i = 0; i + 1 < disk_runs.size() && !hot.empty() && hot[0]->disk; i++)
+            positions_end[&disk_runs[i]] = disk_runs[i + 1].positions;
+        for (size_t i = 0; i < hot.size() && warmed.bytes < limit && !out_of_time(); i++)
+        {
+            if (hot[i]->disk)
+            {
+                const DiskRun &run = *hot[i]->disk;
+                auto end = positions_end.find(&run);
+                warmed.bytes += positions_file.prefetch(run.positions, end != positions_end.end() ? end->second - run.positions
+                                                                                                  : ~0ull,
+                                                        limit - warmed.bytes);
+                continue;
+            }
+            const Node<Document> *first = hot[i]->documents.begin(), *last = hot[i]->documents.last();
+            if (!first || !first->data.positions_on_disk())
+                continue;
+            warmed.bytes += positions_file.prefetch(first->data.positions_offset,
+                                                    last->data.positions_offset + last->data.term_freq -
+                                                        first->data.positions_offset,
+                                                    limit - warmed.bytes);
+            warmed.terms++;
+        }
+        warmed.ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        return warmed;
+    }
+
+    // Builds a Bloom filter of the dictionary's terms, so that terms it does not hold
+    // (typos, rare words) are turned away before the trie is walked; about
+    // false_positive_rate of them still get walked (see Tries/BloomFilter.hpp)
+    // Call it once the index is loaded, before queries run
+    void build_filter(const double &false_positive_rate = 0.01)
+    {
+        dictionary.build_filter(false_positive_rate);
+    }
+
+    // Builds the filter for the index as it is now and writes it for read_filter()
+    void write_filter(const char *filename, const double &false_positive_rate = 0.01)
+    {
+        dictionary.build_filter(false_positive_rate);
+        std::ofstream file;
+        file.open(filename, std::ios::out | std::ios::binary);
+        dictionary.write_filter(file);
+        file.close();
+    }
+
+    // Returns false (and searches without a filter) if the file is missing or was
+    // written for another index; call it after the index is read, before queries run
+    bool read_filter(const char *filename)
+    {
+        std::ifstream file;
+        file.open(filename, std::ios::in | std::ios::binary);
+        return dictionary.read_filter(file);
+    }
+
+    // Limits how much the next read(), read_parallel() or read_split() may load
+    // A limit of 0 removes the budget
+    void set_memory_budget(const unsigned long long &limit,
+                           const MemoryBudget::Policy &policy = MemoryBudget::FAIL)
+    {
+        budget.limit = limit;
+        budget.policy = policy;
+    }
+
+    // True if the last load had to drop positions to stay within budget
+    bool skipped_positions() const
+    {
+        return positions_skipped;
+    }
+
+    // Bytes and object counts of the loaded index
+    MemoryReport memory_report(const unsigned &top = 10)
+    {
+        MemoryReport report = MemoryReport::of(dictionary, top);
+        report.add("Positions file (mapped)", positions_file.mapped(), positions_file.bytes());
+        report.add("Block cache", block_cache ? block_cache->capacity() / block_cache->block_size() : 0,
+                   block_cache ? block_cache->capacity() : 0);
+        report.add("Disk runs", disk_runs.size(), disk_runs.size() * sizeof(DiskRun));
+        report.add("Biwords", biwords.size(), biwords.bytes());
+        report.add("Term filter", dictionary.get_filter().keys(), dictionary.filter_bytes());
+        report.add("Doc map", external_IDs.size(), external_IDs.capacity() * sizeof(unsigned));
+        report.add("Forward store (mapped)", forward_store.size(), forward_store.bytes());
+        return report;
+    }
+
+    // Returns the positions of a term in a doc, loading them if needed
+    std::vector<unsigned> positions(const Document &doc)
+    {
+        std::vector<unsigned> result;
+        if (doc.positions_on_disk())
+        {
+            PositionsFile::Hold hold;
+            const unsigned *p = positions_file.at(doc.positions_offset, doc.term_freq, hold);
+            if (p)
+                result.assign(p, p + doc.term_freq);
+            return result;
+        }
+        for (auto pos = doc.positions.begin(); pos != nullptr; pos = pos->next)
+            result.push_back(pos->data);
+        return result;
+    }
+
+    // Renumbers docs so that similar docs get nearby IDs
+    // Returns the stats before and after so the gain can be reported
+    std::pair<Reorder::Stats, Reorder::Stats> reorder(const unsigned &max_doc = TOTAL_DOCS)
+    {
+        Reorder::Stats before = Reorder::measure(dictionary);
+        std::vector<unsigned> new_ID = Reorder::bisection(dictionary, max_doc);
+        Reorder::apply(dictionary, new_ID);
+        biwords.for_each([&](const std::string &, Posting *posting) { Reorder::apply(posting, new_ID); });
+        forward.renumber(new_ID);
+
+        std::vector<unsigned> previous = external_IDs;
+        external_IDs.assign(max_doc + 1, 0);
+        for (unsigned old_ID = 1; old_ID <= max_doc; old_ID++)
+            external_IDs[new_ID[old_ID]] = old_ID < previous.size() ? previous[old_ID] : old_ID;
+        publish(last_doc, std::max(observe(last_doc), highest_doc())); // docs may move up to max_doc
+        return std::make_pair(before, Reorder::measure(dictionary));
+    }
+
+    // The ID the doc had before any reordering (e.g. its file number)
+    unsigned external_ID(const unsigned &ID) const
+    {
+        return ID < external_IDs.size() ? external_IDs[ID] : ID;
+    }
+
+    // Writes "ID external_ID" lines; nothing is written if docs were never reordered
+    void write_doc_map(const char *filename)
+    {
+        if (external_IDs.empty())
+            return;
+        std::ofstream file;
+        file.open(filename, std::ios::out);
+        for (unsigned ID = 1; ID < external_IDs.size(); ID++)
+            file << ID << " " << external_IDs[ID] << "\n";
+        file.close();
+    }
+
+    // Returns false (and keeps IDs unmapped) if the file does not exist
+    bool read_doc_map(const char *filename)
+    {
+        external_IDs.clear();
+        std::ifstream file;
+        file.open(filename, std::ios::in);
+        unsigned ID, external;
+        while (file >> ID >> external)
+        {
+            if (ID >= external_IDs.size())
+                external_IDs.resize(ID + 1, 0);
+            external_IDs[ID] = external;
+        }
+        return !external_IDs.empty();
+    }
+
+    // Makes index() and index_files() also collect every pair of adjacent words
+    // Call it before indexing, then build_biwords() once the docs are in
+    void collect_biwords()
+    {
+        phrase_support.biwords = nullptr;
+        biwords.clear();
+        collecting_biwords = true;
+    }
+
+    // Keeps the pairs found in at least min_docs docs, plus the pairs of the given
+    // phrases (e.g. those a query log asks for most), and answers phrases with them
+    void build_biwords(const unsigned &min_docs, const std::vector<std::string> &phrases = {})
+    {
+        std::set<std::string> keep;
+        for (const auto &phrase : phrases)
+        {
+            std::string words;
+            for (const char &c : phrase)
+            {
+                if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+                    words.push_back(c);
+                else if (c >= 'A' && c <= 'Z')
+                    words.push_back(c | 32);
+                else if (c == ' ')
+                    words.push_back(' ');
             }
+            auto kept = phrase_words(words, &phrase_support);
+            for (size_t i = 0; i + 1 < kept.size(); i++)
+                if (kept[i + 1].first == kept[i].first + 1)
+                    keep.insert(kept[i].second + " " + kept[i + 1].second);
         }
+        biwords.prune(min_docs, keep);
+        collecting_biwords = false;
+        phrase_support.biwords_last = observe(last_doc);
+        phrase_support.biwords = &biwords;
+    }
+
+    // The first line is the last doc the biwords hold, then one line per pair
+    void write_biwords(const char *filename)
+    {
+        std::ofstream file;
+        file.open(filename, std::ios::out);
+        file << phrase_support.biwords_last << "\n";
+        biwords.write(file);
         file.close();
     }
 
+    // Returns false (and answers phrases from positions alone) if the file is missing or cut short
+    bool read_biwords(const char *filename)
+    {
+        phrase_support.biwords = nullptr;
+        std::ifstream file;
+        file.open(filename, std::ios::in);
+        unsigned last;
+        if (!(file >> last) || !biwords.read(file))
+        {
+            biwords.clear();
+            return false;
+        }
+        phrase_support.biwords_last = last;
+        phrase_support.biwords = &biwords;
+        return true;
+    }
+
+    // Makes index() and index_files() also keep the text of every doc
+    // Call it before indexing, then write_forward() once the docs are in
+    void collect_text()
+    {
+        forward.clear();
+        collecting_text = true;
+    }
+
+    // Writes the collected text (see Storage/ForwardStore.hpp) and stops collecting
+    // Returns false if the file cannot be written
+    bool write_forward(const char *filename)
+    {
+        const bool written = forward.write(filename);
+        forward.clear();
+        collecting_text = false;
+        return written;
+    }
+
+    // Returns false (and leaves text() and snippet() without docs) if the file is missing or damaged
+    bool read_forward(const char *filename)
+    {
+        return forward_store.open(filename);
+    }
+
+    // The stored docs: their paths, lengths and text
+    const ForwardStore &stored() const
+    {
+        return forward_store;
+    }
+
+    // The ID of the doc with this external ID if this index answers for it and its text
+    // is stored; 0 otherwise
+    unsigned stored_ID(const unsigned &external) const
+    {
+        const unsigned ID = forward_store.internal_ID(external);
+        return ID >= first_doc && ID <= observe(last_doc) ? ID : 0;
+    }
+
+    // The stored text of a doc around where the terms of a query in postfix form occur
+    // most, with those words in [brackets] (see ForwardStore::snippet); the doc's start
+    // if none of them occur. Negated terms are not looked for
+    std::string snippet(const unsigned &ID, const std::vector<std::string> &query, const unsigned &context = 8)
+    {
+        if (!forward_store.has(ID))
+            return "";
+        std::vector<unsigned> found;
+        for (size_t i = 0; i < query.size(); i++)
+        {
+            if (is_operator(query[i]) || (i + 1 < query.size() && query[i + 1] == "not"))
+                continue;
+            // A phrase is looked for through its words
+            std::vector<std::string> words(1, query[i]);
+            if (query[i].find(' ') != std::string::npos)
+            {
+                words.clear();
+                for (auto &part : phrase_words(query[i], &phrase_support))
+                    words.push_back(part.second);
+            }
+            for (const auto &word : words)
+            {
+                HashEntry *h = dictionary.search(word);
+                TermCursor term(h ? observe(h->posting) : nullptr, observe(last_doc));
+                if (term.advance_to(ID) != ID)
+                    continue;
+                const std::vector<unsigned> at = positions(*term.document());
+                found.insert(found.end(), at.begin(), at.end());
+            }
+        }
+        std::sort(found.begin(), found.end());
+        found.erase(std::unique(found.begin(), found.end()), found.end());
+        return forward_store.snippet(ID, found, context);
+    }
+
+    // Splits the docs into count ranges of about equal postings and writes one
+    // index file per range plus a manifest naming them (see Build/Shards.hpp)
+    void write_shards(const unsigned &count, const char *manifest_name, const unsigned &max_doc = TOTAL_DOCS)
+    {
+        Shards::write(dictionary, Shards::partition(dictionary, max_doc, count), manifest_name);
+    }
+
+    // Limits NOT (and everything else) to the docs first..last
+    // Set this when the loaded index is a shard
+    void set_doc_range(const unsigned &first, const unsigned &last)
+    {
+        first_doc = first;
+        publish(last_doc, last);
+    }
+
+    // Lets query_eval() split queries over at least min_work postings into doc ranges
+    // evaluated on threads threads (0 = one per core); 1 turns this off
+    void set_query_threads(const unsigned &threads, const unsigned long long &min_work = 1 << 15)
+    {
+        query_pool.reset();
+        if (threads != 1)
+            query_pool.reset(new WorkStealingPool(threads));
+        if (query_pool && query_pool->size() == 1)
+            query_pool.reset();
+        parallel_min_work = min_work;
+    }
+
     HashEntry *search(const std::string &token)
     {
         return dictionary.search(token);
     }
 
-    std::pair<std::vector<unsigned>, bool> query_eval(std::vector<std::string> query)
+    // The entries of many terms, found[i] for terms[i], looked up together (see Trie::search_many)
+    std::vector<HashEntry *> search_many(const std::vector<std::string> &terms)
+    {
+        return dictionary.search_many(terms);
+    }
+
+    // Indexed terms at most max_distance edits away from word, closest and then
+    // most common first (see Trie::fuzzy)
+    std::vector<Trie::Match> suggest(const std::string &word, const unsigned &max_distance = 2,
+                                     const size_t &limit = 10)
+    {
+        return dictionary.fuzzy(word, max_distance, limit);
+    }
+
+    // Replaces the terms of a postfix query that are not indexed by an OR of up to
+    // limit of their closest indexed terms (see Query/Fuzzy.hpp)
+    // Returns the number of terms replaced
+    unsigned expand_fuzzy(std::vector<std::string> &query, const unsigned &max_distance = 2,
+                          const size_t &limit = 3)
+    {
+        return Fuzzy::expand(query, [&](const std::string &word)
+        {
+            // Only the closest terms are used, so a farther search only runs if a nearer one
+            // found nothing; most typos are one edit, which is far cheaper to search than two
+            std::vector<Trie::Match> matches;
+            for (unsigned distance = 1; distance <= Fuzzy::allowed(word, max_distance) && matches.empty(); distance++)
+                matches = dictionary.fuzzy(word, distance, limit);
+            return matches;
+        }, limit);
+    }
+
+    // Rewrites and costs a query in postfix form
+    // Returns nullptr if the query is incorrect
+    PlanPtr plan(const std::vector<std::string> &query)
+    {
+        return Planner(dictionary, observe(last_doc), first_doc, &phrase_support).plan(query);
+    }
+
+    // Builds a single cursor tree for a query in postfix form
+    // Returns nullptr if the query is incorrect
+    CursorPtr cursor(const std::vector<std::string> &query)
+    {
+        Planner planner(dictionary, observe(last_doc), first_doc, &phrase_support);
+        PlanPtr root = planner.plan(query);
+        if (!root)
+            return nullptr;
+        return planner.cursor(root);
+    }
+
+    // EXPLAIN: the query as parsed and the plan query_eval would run
+    // With analyze the plan is also run and every operator shows its input and
+    // output sizes, postings scanned and time; with json everything is on one line
+    std::string explain(const std::vector<std::string> &query, const bool &analyze = false, const bool &json = false)
+    {
+        PlanPtr parsed = Planner::parse(query);
+        if (!parsed)
+            return json ? "{\"error\":\"incorrect query\"}\n" : "Incorrect query\n";
+        const std::string tree = json ? Planner::explain_json(parsed) : Planner::explain(parsed);
+
+        auto start = std::chrono::steady_clock::now();
+        Planner planner(dictionary, observe(last_doc), first_doc, &phrase_support);
+        PlanPtr root = planner.optimize(parsed);
+        unsigned long long docs = 0;
+        if (analyze)
+        {
+            CursorPtr c = planner.cursor(root, true);
+            for (unsigned d = c->doc(); d != NO_MORE_DOCS; d = c->next())
+                docs++;
+        }
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - start).count();
+
+        std::ostringstream out;
+        if (json)
+        {
+            out << "{\"parsed\":" << tree << ",\"plan\":" << Planner::explain_json(root);
+            if (analyze)
+                out << ",\"docs\":" << docs << ",\"ns\":" << nanos;
+            out << "}\n";
+        }
+        else
+        {
+            out << "Parsed:\n" << tree << "Plan:\n" << Planner::explain(root);
+            if (analyze)
+                out << "Result: " << docs << " docs in " << nanos << " ns\n";
+        }
+        return out.str();
+    }
+
+    std::pair<std::vector<unsigned>, bool> query_eval(std::vector<std::string> query, QueryBudget *budget = nullptr)
     {
         // Vector is the result containg IDs of all docs that satisfy query
         // Bool will be false if query is incorrect
         // Remember query is in postfix form
+        // The query is planned first, then evaluated in one pass over a tree of cursors
+
+        // A large query is cut into doc ranges that are evaluated at the same time
+        // (see set_query_threads()); a range's results are all below the next range's
+
+        // With a budget the query stops once it is spent (see Query/Budget.hpp) and is
+        // counted in budget_stats(); then it fails under QueryBudget::ABORT, and under
+        // PARTIAL returns the docs found before that: every one of them matches, but
+        // others that match are missing (budget->exceeded() tells the two apart)
+
+        // A query that finds postings or positions of a disk-resident index it cannot read
+        // fails too, rather than answer without the docs it could not see
 
-        const int len = query.size();
-        std::vector<bool> done_or_not(len, false); // keeps track of what's been done
-        std::map<std::string, std::vector<unsigned>> m;
         std::vector<unsigned> result;
+        const unsigned last = observe(last_doc); // the whole query sees the docs up to here
+        Planner planner(dictionary, last, first_doc, &phrase_support);
+        PlanPtr plan = planner.plan(query);
+        if (!plan)
+            return std::pair<std::vector<unsigned>, bool> (result, false);
+        log_terms(query);
+        planner.set_budget(budget);
 
-        if (len == 1)
+        if (!query_pool || Partition::work(plan) < parallel_min_work)
         {
-            auto h = dictionary.search(query[0]);
-            if (h)
-            {
-                auto p = h->posting->documents.begin();
-                while (p)
-                {
-                    result.push_back(p->data.ID);
-                    p = p->next;
-                }
-            }
-            return std::pair<std::vector<unsigned>, bool> (result, true);
+            CursorPtr root = planner.cursor(plan);
+            drain(root, budget, result);
+            return over_budget(budget) || planner.failed()
+                       ? std::pair<std::vector<unsigned>, bool> (std::vector<unsigned>(), false)
+                       : std::pair<std::vector<unsigned>, bool> (result, true);
         }
 
-        for (int i = 0; i < len; i++)
+        // More ranges than threads, so a thread that finishes early steals another
+        std::vector<Partition::Interval> ranges = Partition::intervals(plan, first_doc, last,
+                                                                       4 * query_pool->size());
+        std::vector<std::vector<unsigned>> parts(ranges.size());
+        std::atomic<bool> failed{false};
+        query_pool->parallel_for(ranges.size(), [&](const size_t &i)
+        {
+            Planner part(dictionary, last, first_doc, &phrase_support);
+            part.set_budget(budget);
+            CursorPtr root = part.cursor_in(plan, ranges[i].first, ranges[i].second);
+            drain(root, budget, parts[i]);
+            if (part.failed())
+                failed = true;
+        });
+        if (over_budget(budget) || failed)
+            return std::pair<std::vector<unsigned>, bool> (result, false);
+        for (const auto &part : parts)
+            result.insert(result.end(), part.begin(), part.end());
+        return std::pair<std::vector<unsigned>, bool> (result, true);
+    }
+
+    // How the queries given a budget went, since the index was loaded
+    BudgetStats budget_stats() const
+    {
+        return budget_counters.stats();
+    }
+
+    // Answers many queries in postfix form, each as query_eval() would
+    // A posting list (or phrase, or subexpression) that several of them use is scanned
+    // once for the whole batch instead of once per query (see Planner::plan_batch), so
+    // the postings read grow with the distinct terms of a batch, not with its size
+    std::vector<std::pair<std::vector<unsigned>, bool>> query_batch(const std::vector<std::vector<std::string>> &queries)
+    {
+        std::vector<std::pair<std::vector<unsigned>, bool>> results(queries.size());
+        Planner planner(dictionary, observe(last_doc), first_doc, &phrase_support);
+        const std::vector<PlanPtr> plans = planner.plan_batch(queries);
+        for (size_t i = 0; i < plans.size(); i++)
+        {
+            if (!plans[i])
+                continue;
+            log_terms(queries[i]);
+            results[i].second = true;
+            CursorPtr root = planner.batch_cursor(plans[i]);
+            for (unsigned d = root->doc(); d != NO_MORE_DOCS; d = root->next())
+                results[i].first.push_back(d);
+        }
+        // The shared scans serve every query, so one that cannot be read fails them all
+        if (planner.failed())
+            for (auto &result : results)
+                result = std::make_pair(std::vector<unsigned>(), false);
+        return results;
+    }
+
+    // How many docs satisfy a query in postfix form, without listing them
+    // Every operator counts in its own way (see PostingCursor::count_to()), so a term
+    // is counted from its skips and an AND of similar terms through bitmaps
+    // A count visits every match anyway, so shared subplans are still materialized
+    // once rather than scanned again by each of their uses
+    // Bool will be false if query is incorrect or its postings cannot be read
+    std::pair<unsigned long long, bool> count(const std::vector<std::string> &query)
+    {
+        const unsigned last = observe(last_doc);
+        Planner planner(dictionary, last, first_doc, &phrase_support);
+        PlanPtr plan = planner.plan(query);
+        if (!plan)
+            return std::make_pair(0ull, false);
+        log_terms(query);
+
+        if (!query_pool || Partition::work(plan) < parallel_min_work)
+        {
+            const unsigned long long counted = planner.cursor(plan)->count_to(NO_MORE_DOCS - 1);
+            return planner.failed() ? std::make_pair(0ull, false) : std::make_pair(counted, true);
+        }
+
+        std::vector<Partition::Interval> ranges = Partition::intervals(plan, first_doc, last,
+                                                                       4 * query_pool->size());
+        std::vector<unsigned long long> counts(ranges.size(), 0);
+        std::atomic<bool> failed{false};
+        query_pool->parallel_for(ranges.size(), [&](const size_t &i)
+        {
+            Planner part(dictionary, last, first_doc, &phrase_support);
+            counts[i] = part.cursor_in(plan, ranges[i].first, ranges[i].second)->count_to(NO_MORE_DOCS - 1);
+            if (part.failed())
+                failed = true;
+        });
+        if (failed)
+            return std::make_pair(0ull, false);
+        unsigned long long total = 0;
+        for (const auto &n : counts)
+            total += n;
+        return std::make_pair(total, true);
+    }
+
+    // Whether any doc satisfies a query in postfix form
+    // A lazy cursor tree stops at its first doc, so only as much is evaluated as it takes
+    // to find one, and shared subplans are not materialized on the way
+    // The second bool will be false if query is incorrect or its postings cannot be read
+    std::pair<bool, bool> exists(const std::vector<std::string> &query)
+    {
+        Planner planner(dictionary, observe(last_doc), first_doc, &phrase_support);
+        PlanPtr plan = planner.plan(query);
+        if (!plan)
+            return std::make_pair(false, false);
+        log_terms(query);
+        const bool found = planner.lazy_cursor(plan, 1)->doc() != NO_MORE_DOCS;
+        return std::make_pair(found, !planner.failed());
+    }
+
+    // Up to limit docs of a query in postfix form that come after the doc after_doc,
+    // in ascending ID order (see Query/Paging.hpp)
+    // Only as many docs are evaluated as the page holds, plus one to know whether
+    // there is another page, so a page costs the same however many docs match
+    // Bool will be false if query is incorrect or its postings cannot be read
+    std::pair<Paging::Page, bool> query(const std::vector<std::string> &query, const unsigned &limit,
+                                        const unsigned &after_doc = 0)
+    {
+        Paging::Page page;
+        Planner planner(dictionary, observe(last_doc), first_doc, &phrase_support);
+        PlanPtr plan = planner.plan(query);
+        if (!plan)
+            return std::make_pair(page, false);
+        log_terms(query);
+        if (after_doc == NO_MORE_DOCS - 1)
+            return std::make_pair(page, true);
+
+        CursorPtr root = planner.lazy_cursor(plan, after_doc + 1);
+        unsigned d = root->doc();
+        for (; d != NO_MORE_DOCS && page.docs.size() < limit; d = root->next())
+            page.docs.push_back(d);
+        if (planner.failed())
+            return std::make_pair(Paging::Page(), false);
+        if (d != NO_MORE_DOCS)
+            page.token = Paging::token(query, page.docs.empty() ? after_doc : page.docs.back());
+        return std::make_pair(page, true);
+    }
+
+    // The page after the one whose continuation token is given
+    // Bool will be false if query is incorrect or the token is not one of its tokens
+    std::pair<Paging::Page, bool> resume(const std::vector<std::string> &query, const unsigned &limit,
+                                         const std::string &token)
+    {
+        unsigned after_doc;
+        if (!Paging::resume(token, query, after_doc))
+            return std::make_pair(Paging::Page(), false);
+        return this->query(query, limit, after_doc);
+    }
+
+    // Hands the docs of a query in postfix form to emit(chunk) in ascending ID order,
+    // chunk_size docs at a time and as soon as each chunk is complete
+    // emit returns false to stop early
+    // Returns false if query is incorrect, or if its postings cannot be read (after the
+    // chunks before that were emitted)
+    template <typename Emit>
+    bool stream(const std::vector<std::string> &query, Emit emit, const unsigned &chunk_size = 64,
+                const unsigned &after_doc = 0)
+    {
+        Planner planner(dictionary, observe(last_doc), first_doc, &phrase_support);
+        PlanPtr plan = planner.plan(query);
+        if (!plan)
+            return false;
+        log_terms(query);
+        if (after_doc == NO_MORE_DOCS - 1)
+            return true;
+
+        CursorPtr root = planner.lazy_cursor(plan, after_doc + 1);
+        std::vector<unsigned> chunk;
+        for (unsigned d = root->doc(); d != NO_MORE_DOCS; d = root->next())
         {
-            if (query[i] == "not")
+            if (planner.failed())
+                return false;
+            chunk.push_back(d);
+            if (chunk.size() >= chunk_size)
             {
-                // Find the term to NOT
-                int j = i - 1;
-                for (;j >= 0; j--)
-                {
-                    if (!is_operator(query[j]))
-                        break;
-                }
-                if (j == -1) // Incorrect query
-                    return std::pair<std::vector<unsigned>, bool> (result, false);
-                if (done_or_not[j] == false)
-                {
-                    done_or_not[j] = true;
-                    m[query[j]] = dictionary.NOT(query[j]);
-                    result = m[query[j]];
-                }
-                else
-                {
-                    m[query[j]] = dictionary.NOT(m[query[j]]);
-                    result = m[query[j]];
-                }
+                if (!emit(chunk))
+                    return true;
+                chunk.clear();
             }
-            else if (query[i] == "and")
+        }
+        if (planner.failed())
+            return false;
+        if (!chunk.empty())
+            emit(chunk);
+        return true;
+    }
+
+    // The k matching docs in which the query's terms occur most often, as (score, ID) pairs
+    // A doc's score is the sum of the term frequencies of the query terms it contains
+    // Ties go to the lower external ID so that shards and a whole index agree
+    std::pair<std::vector<std::pair<unsigned, unsigned>>, bool> ranked_eval(const std::vector<std::string> &query,
+                                                                             const unsigned &k)
+    {
+        std::vector<std::pair<unsigned, unsigned>> ranked;
+        auto matching = query_eval(query);
+        if (!matching.second)
+            return std::make_pair(ranked, false);
+        const std::vector<unsigned> &docs = matching.first;
+
+        std::vector<unsigned> scores(docs.size(), 0);
+        std::vector<std::string> terms;
+        for (const auto &word : query)
+        {
+            if (is_operator(word))
+                continue;
+            // A phrase scores through its words
+            std::vector<std::string> words(1, word);
+            if (word.find(' ') != std::string::npos)
             {
-                // Find the terms to AND
-                int j = i - 1;
-                for (;j >= 0; j--)
-                {
-                    if (!is_operator(query[j]))
-                        break;
-                }
-                if (j == -1) // Incorrect query
-                    return std::pair<std::vector<unsigned>, bool> (result, false);
-                int k = j - 1;
-                for (;k >= 0; k--)
-                {
-                    if (!is_operator(query[k]))
-                        break;
-                }
-                if (k == -1) // Incorrect query
-                    return std::pair<std::vector<unsigned>, bool> (result, false);
-                
-                if (done_or_not[j] == false && done_or_not[k] == false)
-                {
-                    done_or_not[j] = true;
-                    done_or_not[k] = true;
-                    m[query[j]] = dictionary.AND(query[j], query[k]);
-                    m[query[k]] = m[query[j]];
-                    result = m[query[j]];
-                }
-                else if (done_or_not[j] == true && done_or_not[k] == false)
-                {
-                    done_or_not[k] = true;
-                    m[query[j]] = dictionary.AND(query[k], m[query[j]]);
-                    m[query[k]] = m[query[j]];
-                    result = m[query[j]];
-                }
-                else if (done_or_not[j] == false && done_or_not[k] == true)
-                {
-                    done_or_not[j] = true;
-                    m[query[j]] = dictionary.AND(query[j], m[query[k]]);
-                    m[query[k]] = m[query[j]];
-                    result = m[query[j]];
-                }
-                else
-                {
-                    m[query[j]] = dictionary.AND(m[query[j]], m[query[k]]);
-                    m[query[k]] = m[query[j]];
-                    result = m[query[j]];
-                }
+                words.clear();
+                for (auto &part : phrase_words(word, &phrase_support))
+                    words.push_back(part.second);
             }
-            else if (query[i] == "or")
+            for (const auto &w : words)
+                if (std::find(terms.begin(), terms.end(), w) == terms.end())
+                    terms.push_back(w);
+        }
+        const std::vector<HashEntry *> found = dictionary.search_many(terms);
+        std::atomic<bool> failed{false};
+        for (HashEntry *h : found)
+        {
+            const Posting *posting = h ? observe(h->posting) : nullptr;
+            if (!posting)
+                continue;
+            // Both lists are ascending, so one pass finds the docs the term is in
+            TermCursor cursor(posting, NO_MORE_DOCS - 1, &failed);
+            for (size_t i = 0; i < docs.size() && cursor.doc() != NO_MORE_DOCS; i++)
             {
-                // Find the terms to OR
-                int j = i - 1;
-                for (;j >= 0; j--)
-                {
-                    if (!is_operator(query[j]))
-                        break;
-                }
-                if (j == -1) // Incorrect query
-                    return std::pair<std::vector<unsigned>, bool> (result, false);
-                int k = j - 1;
-                for (;k >= 0; k--)
-                {
-                    if (!is_operator(query[k]))
-                        break;
-                }
-                if (k == -1) // Incorrect query
-                    return std::pair<std::vector<unsigned>, bool> (result, false);
-                if (done_or_not[j] == false && done_or_not[k] == false)
-                {
-                    done_or_not[j] = true;
-                    done_or_not[k] = true;
-                    m[query[j]] = dictionary.OR(query[j], query[k]);
-                    m[query[k]] = m[query[j]];
-                    result = m[query[j]];
-                }
-                else if (done_or_not[j] == true && done_or_not[k] == false)
-                {
-                    done_or_not[k] = true;
-                    m[query[j]] = dictionary.OR(query[k], m[query[j]]);
-                    m[query[k]] = m[query[j]];
-                    result = m[query[j]];
-                }
-                else if (done_or_not[j] == false && done_or_not[k] == true)
-                {
-                    done_or_not[j] = true;
-                    m[query[j]] = dictionary.OR(query[j], m[query[k]]);
-                    m[query[k]] = m[query[j]];
-                    result = m[query[j]];
-                }
-                else
-                {
-                    m[query[j]] = dictionary.OR(m[query[j]], m[query[k]]);
-                    m[query[k]] = m[query[j]];
-                    result = m[query[j]];
-                }
+                if (cursor.advance_to(docs[i]) == docs[i])
+                    scores[i] += cursor.document()->term_freq;
             }
         }
-        return std::pair<std::vector<unsigned>, bool> (result, true);
+        if (failed)
+            return std::make_pair(ranked, false);
+
+        for (size_t i = 0; i < docs.size(); i++)
+            ranked.emplace_back(scores[i], docs[i]);
+        const size_t keep = std::min<size_t>(k, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(),
+                          [this](const std::pair<unsigned, unsigned> &a, const std::pair<unsigned, unsigned> &b)
+                          {
+                              if (a.first != b.first)
+                                  return a.first > b.first;
+                              return external_ID(a.second) < external_ID(b.second);
+                          });
+        ranked.resize(keep);
+        return std::make_pair(ranked, true);
     }
 };
 #endif
\ No newline at end of file
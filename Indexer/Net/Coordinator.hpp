@@ -0,0 +1,455 @@
+#pragma once
+#ifndef COORDINATOR_HPP
+#define COORDINATOR_HPP
+
+#include "Protocol.hpp"
+#include "UnixSocket.hpp"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Scatter-gather over shard servers that each hold a range of the docs
+// Every request is checked, sent to all shards at once and their answers merged;
+// it speaks the same line protocol as a single server (see Protocol.hpp),
+// so anything that talks to main_server can talk to a coordinator
+class Coordinator
+{
+public:
+    // A shard that has not answered timeout_ms after the request was sent fails it
+    Coordinator(std::vector<std::string> shard_paths, const unsigned &timeout_ms)
+        : paths(std::move(shard_paths)), timeout(timeout_ms) {}
+
+    // Thread safe: every concurrent request gets its own connections to the shards
+    std::string answer(const std::string &request)
+    {
+        // Incorrect queries are turned away before any shard sees them
+        std::vector<std::string> postfix;
+        unsigned k = 0;
+        std::string query, token;
+        if (Protocol::split_mode(request, "SUGGEST", query))
+        {
+            const std::string word = Protocol::suggest_word(query);
+            if (word.empty())
+                return "ERR incorrect word";
+            std::unique_ptr<Session> session = acquire();
+            std::vector<Trie::Match> matches;
+            std::string response = suggest(*session, word, matches);
+            release(std::move(session));
+            return response.empty() ? Protocol::suggestions(matches) : response;
+        }
+        if (Protocol::split_mode(request, "FUZZY", query))
+        {
+            // Corrections come from every shard's terms, then the shards get the corrected query
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            std::unique_ptr<Session> session = acquire();
+            std::string failed;
+            Fuzzy::expand(postfix, [&](const std::string &word)
+            {
+                std::vector<Trie::Match> matches;
+                if (failed.empty())
+                    failed = suggest(*session, word, matches);
+                // As Indexer::expand_fuzzy allows
+                const unsigned allowed = Fuzzy::allowed(word, 2);
+                while (!matches.empty() && matches.back().distance > allowed)
+                    matches.pop_back();
+                return matches;
+            });
+            release(std::move(session));
+            return failed.empty() ? answer(to_infix(postfix)) : failed;
+        }
+        if (request == "CACHE")
+        {
+            // Every shard's cache, added up
+            std::unique_ptr<Session> session = acquire();
+            std::vector<std::string> responses;
+            std::vector<unsigned> missing = scatter(*session, request, responses);
+            release(std::move(session));
+            if (!missing.empty())
+                return "ERR no answer from shard " + std::to_string(missing.front());
+            BlockCache::Stats total, part;
+            for (size_t i = 0; i < responses.size(); i++)
+            {
+                if (!Protocol::read_cache_stats(responses[i], part))
+                    return "ERR malformed answer from shard " + std::to_string(i + 1);
+                total.hits += part.hits;
+                total.misses += part.misses;
+                total.evictions += part.evictions;
+                total.overflows += part.overflows;
+                total.bytes_read += part.bytes_read;
+            }
+            return Protocol::cache_stats(total);
+        }
+        if (request == "BUDGET")
+        {
+            std::unique_ptr<Session> session = acquire();
+            std::vector<std::string> responses;
+            std::vector<unsigned> missing = scatter(*session, request, responses);
+            release(std::move(session));
+            if (!missing.empty())
+                return "ERR no answer from shard " + std::to_string(missing.front());
+            BudgetStats total, part;
+            for (size_t i = 0; i < responses.size(); i++)
+            {
+                if (!Protocol::read_budget_stats(responses[i], part))
+                    return "ERR malformed answer from shard " + std::to_string(i + 1);
+                total.queries += part.queries;
+                total.over_time += part.over_time;
+                total.over_work += part.over_work;
+                total.cancelled += part.cancelled;
+                total.partial += part.partial;
+                total.aborted += part.aborted;
+            }
+            return Protocol::budget_stats(total);
+        }
+        bool partial;
+        if (Protocol::split_deadline(request, k, partial, query))
+        {
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            return deadline(k, partial, query);
+        }
+        if (Protocol::split_snippet(request, k, query))
+        {
+            // Only the shard holding the doc has it stored and in range
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            std::unique_ptr<Session> session = acquire();
+            std::vector<std::string> responses;
+            std::vector<unsigned> missing = scatter(*session, request, responses);
+            release(std::move(session));
+            for (const auto &response : responses)
+            {
+                if (response.compare(0, 3, "OK ") == 0)
+                    return response;
+            }
+            return missing.empty() ? "ERR unknown doc" : "ERR no answer from the shard holding the doc";
+        }
+        if (Protocol::split_page(request, k, token, query))
+        {
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            std::unique_ptr<Session> session = acquire();
+            std::string response = page(*session, k, token, query);
+            release(std::move(session));
+            return response;
+        }
+        const bool top = Protocol::split_top(request, k, query);
+        const bool count = !top && Protocol::split_mode(request, "COUNT", query);
+        const bool exists = !top && !count && Protocol::split_mode(request, "EXISTS", query);
+        const bool explain = !top && !count && !exists && request.compare(0, 8, "EXPLAIN ") == 0;
+        if (!top && !count && !exists)
+            query = explain ? request.substr(8) : request;
+        if (!parse_query(query, postfix))
+            return "ERR incorrect query";
+
+        std::unique_ptr<Session> session = acquire();
+        std::vector<std::string> responses;
+        std::vector<unsigned> missing = scatter(*session, request, responses);
+        release(std::move(session));
+
+        if (!missing.empty())
+        {
+            std::ostringstream out;
+            out << "ERR no answer from shard";
+            for (const auto &shard : missing)
+                out << " " << shard;
+            return out.str();
+        }
+        for (const auto &response : responses)
+        {
+            if (response.compare(0, 3, "OK ") != 0)
+                return response;
+        }
+
+        if (explain)
+        {
+            std::string out = "OK {\"shards\":[";
+            for (size_t i = 0; i < responses.size(); i++)
+                out += (i ? "," : "") + responses[i].substr(3);
+            return out + "]}";
+        }
+        if (count || exists)
+            return gather_count(responses, exists);
+        return top ? gather_top(responses, k) : gather(responses);
+    }
+
+private:
+    // One connection per shard; reopened after a shard fails
+    struct Session
+    {
+        std::vector<LineSocket> shards;
+    };
+
+    std::vector<std::string> paths;
+    std::chrono::milliseconds timeout;
+    std::mutex lock;
+    std::vector<std::unique_ptr<Session>> idle;
+
+    std::unique_ptr<Session> acquire()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!idle.empty())
+            {
+                std::unique_ptr<Session> session = std::move(idle.back());
+                idle.pop_back();
+                return session;
+            }
+        }
+        std::unique_ptr<Session> session(new Session);
+        session->shards.resize(paths.size());
+        return session;
+    }
+
+    void release(std::unique_ptr<Session> session)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        idle.push_back(std::move(session));
+    }
+
+    // Sends request to every shard before waiting on any, so they work in parallel
+    // Returns the (1-based) shards that did not answer in time: within wait if it
+    // is given, else within the coordinator's timeout
+    std::vector<unsigned> scatter(Session &session, const std::string &request, std::vector<std::string> &responses,
+                                  const std::chrono::milliseconds &wait = std::chrono::milliseconds::zero())
+    {
+        const size_t n = paths.size();
+        std::vector<bool> sent(n, false);
+        for (size_t i = 0; i < n; i++)
+        {
+            LineSocket &shard = session.shards[i];
+            if (shard.is_open() && shard.write_line(request))
+                sent[i] = true;
+            else
+            {
+                // The connection may have gone stale since the last request
+                shard = LineSocket::connect_to(paths[i]);
+                sent[i] = shard.is_open() && shard.write_line(request);
+            }
+        }
+
+        std::vector<unsigned> missing;
+        responses.assign(n, "");
+        const auto deadline = std::chrono::steady_clock::now() + (wait.count() ? wait : timeout);
+        for (size_t i = 0; i < n; i++)
+        {
+            if (!sent[i] || !session.shards[i].read_line(responses[i], deadline))
+            {
+                session.shards[i].close(); // a late answer must not be read as the next one
+                missing.push_back(i + 1);
+            }
+        }
+        return missing;
+    }
+
+    // A query answered within ms (0 means the coordinator's timeout) by every shard
+    // Shards get a tenth less time, to send what they have before the coordinator stops
+    // waiting; with partial the docs of the shards that answered in time are merged and
+    // flagged as partial if any shard was late or stopped short
+    std::string deadline(const unsigned &ms, const bool &partial, const std::string &query)
+    {
+        const unsigned wait = ms && ms < timeout.count() ? ms : timeout.count();
+        std::ostringstream request;
+        request << "DEADLINE " << (ms ? ms - ms / 10 : 0) << (partial ? " PARTIAL " : " ABORT ") << query;
+
+        std::unique_ptr<Session> session = acquire();
+        std::vector<std::string> responses;
+        std::vector<unsigned> missing = scatter(*session, request.str(), responses, std::chrono::milliseconds(wait));
+        release(std::move(session));
+
+        if (!missing.empty() && !partial)
+            return "ERR over deadline";
+        bool cut = !missing.empty();
+        std::vector<std::string> answered;
+        for (size_t i = 0; i < responses.size(); i++)
+        {
+            if (std::find(missing.begin(), missing.end(), i + 1) != missing.end())
+                continue;
+            if (responses[i].compare(0, 3, "OK ") != 0)
+                return responses[i];
+            cut |= Protocol::is_partial(responses[i]);
+            answered.push_back(responses[i]);
+        }
+        std::string merged = gather(answered);
+        return cut && merged.compare(0, 3, "OK ") == 0 ? merged + " PARTIAL" : merged;
+    }
+
+    // The best suggestions for word over all shards: a term's docs are added up and
+    // its distance is the same everywhere
+    // Returns "" on success, else the error to answer with
+    std::string suggest(Session &session, const std::string &word, std::vector<Trie::Match> &matches)
+    {
+        std::vector<std::string> responses;
+        std::vector<unsigned> missing = scatter(session, "SUGGEST " + word, responses);
+        if (!missing.empty())
+            return "ERR no answer from shard " + std::to_string(missing.front());
+
+        std::vector<Trie::Match> part;
+        for (size_t i = 0; i < responses.size(); i++)
+        {
+            if (!Protocol::read_suggestions(responses[i], part))
+                return "ERR malformed answer from shard " + std::to_string(i + 1);
+            for (const auto &match : part)
+            {
+                auto same = std::find_if(matches.begin(), matches.end(),
+                                         [&](const Trie::Match &m) { return m.term == match.term; });
+                if (same == matches.end())
+                    matches.push_back(match);
+                else
+                    same->doc_count += match.doc_count;
+            }
+        }
+        std::sort(matches.begin(), matches.end());
+        if (matches.size() > 10)
+            matches.resize(10);
+        return "";
+    }
+
+    // Sends request to one shard and waits for its answer until deadline
+    bool ask(Session &session, const size_t &i, const std::string &request, std::string &response,
+             const std::chrono::steady_clock::time_point &deadline)
+    {
+        LineSocket &shard = session.shards[i];
+        if (!shard.is_open() || !shard.write_line(request))
+        {
+            shard = LineSocket::connect_to(paths[i]);
+            if (!shard.is_open() || !shard.write_line(request))
+                return false;
+        }
+        if (shard.read_line(response, deadline))
+            return true;
+        shard.close();
+        return false;
+    }
+
+    // Shard i holds lower docs than shard i + 1, so paging runs through the shards in turn,
+    // asking one after another only until the page is full
+    // The coordinator's token is "<shard>.<that shard's token>"; once a shard has run out
+    // the next page starts at the next shard, and may turn out empty
+    std::string page(Session &session, const unsigned &limit, const std::string &token, const std::string &query)
+    {
+        size_t shard = 0;
+        std::string at = "-"; // the token within shard
+        if (token != "-")
+        {
+            const size_t dot = token.find('.');
+            if (dot == 0 || dot == std::string::npos || token.find_first_not_of("0123456789") != dot ||
+                (shard = std::stoul(token.substr(0, dot))) >= paths.size())
+                return "ERR incorrect query or token";
+            at = token.substr(dot + 1);
+        }
+
+        std::vector<unsigned> docs, part;
+        std::string next = "-";
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (; shard < paths.size(); shard++, at = "-")
+        {
+            std::ostringstream request;
+            request << "PAGE " << limit - docs.size() << " " << at << " " << query;
+            std::string response;
+            if (!ask(session, shard, request.str(), response, deadline))
+                return "ERR no answer from shard " + std::to_string(shard + 1);
+            if (response.compare(0, 3, "OK ") != 0)
+                return response;
+            if (!Protocol::read_page(response, part, next))
+                return "ERR malformed answer from shard " + std::to_string(shard + 1);
+            docs.insert(docs.end(), part.begin(), part.end());
+            if (next != "-")
+            {
+                next = std::to_string(shard) + "." + next;
+                break;
+            }
+            if (docs.size() >= limit)
+            {
+                if (shard + 1 < paths.size())
+                    next = std::to_string(shard + 1) + ".-";
+                break;
+            }
+        }
+
+        std::ostringstream out;
+        out << "OK " << docs.size();
+        for (const auto &ID : docs)
+            out << " " << ID;
+        out << " " << next;
+        return out.str();
+    }
+
+    // Every shard's IDs are ascending; a k-way merge keeps them so
+    static std::string gather(const std::vector<std::string> &responses)
+    {
+        std::vector<std::vector<unsigned>> lists(responses.size());
+        using Head = std::pair<unsigned, size_t>; // (doc ID, list)
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        std::vector<size_t> at(responses.size(), 0);
+        size_t total = 0;
+        for (size_t i = 0; i < responses.size(); i++)
+        {
+            if (!Protocol::read_answer(responses[i], lists[i]))
+                return "ERR malformed answer from shard " + std::to_string(i + 1);
+            total += lists[i].size();
+            if (!lists[i].empty())
+                heads.emplace(lists[i][0], i);
+        }
+
+        std::ostringstream out;
+        out << "OK " << total;
+        while (!heads.empty())
+        {
+            Head head = heads.top();
+            heads.pop();
+            out << " " << head.first;
+            if (++at[head.second] < lists[head.second].size())
+                heads.emplace(lists[head.second][at[head.second]], head.second);
+        }
+        return out.str();
+    }
+
+    // Shards hold disjoint docs, so their counts add up; a doc exists if any shard has one
+    static std::string gather_count(const std::vector<std::string> &responses, const bool &exists)
+    {
+        unsigned long long total = 0, part;
+        for (size_t i = 0; i < responses.size(); i++)
+        {
+            if (!Protocol::read_count(responses[i], part))
+                return "ERR malformed answer from shard " + std::to_string(i + 1);
+            total += part;
+        }
+        return "OK " + std::to_string(exists ? total > 0 : total);
+    }
+
+    // The best k of the shards' best k, ordered as Indexer::ranked_eval orders them
+    static std::string gather_top(const std::vector<std::string> &responses, const unsigned &k)
+    {
+        std::vector<std::pair<unsigned, unsigned>> all, part;
+        for (size_t i = 0; i < responses.size(); i++)
+        {
+            if (!Protocol::read_ranked(responses[i], part))
+                return "ERR malformed answer from shard " + std::to_string(i + 1);
+            all.insert(all.end(), part.begin(), part.end());
+        }
+        const size_t keep = std::min<size_t>(k, all.size());
+        std::partial_sort(all.begin(), all.begin() + keep, all.end(),
+                          [](const std::pair<unsigned, unsigned> &a, const std::pair<unsigned, unsigned> &b)
+                          {
+                              if (a.first != b.first)
+                                  return a.first > b.first;
+                              return a.second < b.second;
+                          });
+
+        std::ostringstream out;
+        out << "OK " << keep;
+        for (size_t i = 0; i < keep; i++)
+            out << " " << all[i].second << ":" << all[i].first;
+        return out.str();
+    }
+};
+
+#endif
@@ -0,0 +1,351 @@
+#pragma once
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include "../Indexer.hpp"
+#include "../Query/Parser.hpp"
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The line protocol spoken by main_server
+//   request  "<query>"          -> "OK <count> <doc ID>*"  (external doc IDs, ascending)
+//   request  "TOP <k> <query>"  -> "OK <count> (<doc ID>:<score>)*" (best k, see Indexer::ranked_eval)
+//   request  "EXPLAIN <query>"  -> "OK <explain analyze as JSON>"
+//   request  "COUNT <query>"    -> "OK <count>"
+//   request  "EXISTS <query>"   -> "OK 1" or "OK 0"
+//   request  "PAGE <limit> <token> <query>" -> "OK <count> <doc ID>* <token>"
+//            (the first page is asked for with token "-"; the last one ends in "-";
+//             docs are in index order, see Indexer::query)
+//   request  "FUZZY <query>"    -> as "<query>" with misspelled terms corrected (see Query/Fuzzy.hpp)
+//   request  "SUGGEST <word>"   -> "OK <count> (<term>:<distance>:<doc count>)*" (see Indexer::suggest)
+//   request  "SNIPPET <doc ID> <query>" -> "OK <path> <text around the query's words>"
+//            (see Indexer::snippet; ERR if the doc is not stored in this index)
+//   request  "CACHE"            -> "OK <hits> <misses> <evictions> <overflows> <bytes read>"
+//            (the block cache of a disk-resident index, see Indexer::read_blocks)
+//   request  "DEADLINE <ms> ABORT|PARTIAL <query>" -> as "<query>", if answered within ms;
+//            past that ABORT answers "ERR over deadline" and PARTIAL answers with the docs
+//            found so far followed by " PARTIAL" (see Indexer::query_eval and Query/Budget.hpp)
+//   request  "BUDGET"           -> "OK <queries> <over time> <over work> <cancelled> <partial> <aborted>"
+//            (how the queries with a deadline went, see Indexer::budget_stats)
+//   any incorrect request       -> "ERR <reason>"
+namespace Protocol
+{
+    // Splits "TOP <k> <query>" into k and the query; false for any other request
+    inline bool split_top(const std::string &request, unsigned &k, std::string &query)
+    {
+        if (request.compare(0, 4, "TOP ") != 0)
+            return false;
+        std::istringstream in(request.substr(4));
+        if (!(in >> k))
+            return false;
+        std::getline(in >> std::ws, query);
+        return true;
+    }
+
+    // Splits "<word> <query>" into the query; false if request does not start with word
+    inline bool split_mode(const std::string &request, const std::string &word, std::string &query)
+    {
+        if (request.size() <= word.size() || request.compare(0, word.size(), word) != 0 ||
+            request[word.size()] != ' ')
+            return false;
+        query = request.substr(word.size() + 1);
+        return true;
+    }
+
+    // Splits "PAGE <limit> <token> <query>"; false for any other request
+    inline bool split_page(const std::string &request, unsigned &limit, std::string &token, std::string &query)
+    {
+        if (request.compare(0, 5, "PAGE ") != 0)
+            return false;
+        std::istringstream in(request.substr(5));
+        if (!(in >> limit >> token))
+            return false;
+        std::getline(in >> std::ws, query);
+        return true;
+    }
+
+    // The word of a SUGGEST request as the parser would read it; empty if it has no letters
+    inline std::string suggest_word(const std::string &text)
+    {
+        std::string word;
+        for (const char &c : text)
+        {
+            if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+                word.push_back(c);
+            else if (c >= 'A' && c <= 'Z')
+                word.push_back(c | 32);
+        }
+        return word;
+    }
+
+    // Splits "SNIPPET <doc ID> <query>"; false for any other request
+    inline bool split_snippet(const std::string &request, unsigned &ID, std::string &query)
+    {
+        if (request.compare(0, 8, "SNIPPET ") != 0)
+            return false;
+        std::istringstream in(request.substr(8));
+        if (!(in >> ID))
+            return false;
+        std::getline(in >> std::ws, query);
+        return true;
+    }
+
+    // Splits "DEADLINE <ms> ABORT|PARTIAL <query>"; false for any other request
+    inline bool split_deadline(const std::string &request, unsigned &ms, bool &partial, std::string &query)
+    {
+        if (request.compare(0, 9, "DEADLINE ") != 0)
+            return false;
+        std::istringstream in(request.substr(9));
+        std::string policy;
+        if (!(in >> ms >> policy) || (policy != "ABORT" && policy != "PARTIAL"))
+            return false;
+        partial = policy == "PARTIAL";
+        std::getline(in >> std::ws, query);
+        return true;
+    }
+
+    // The answer to SUGGEST
+    inline std::string suggestions(const std::vector<Trie::Match> &matches)
+    {
+        std::ostringstream out;
+        out << "OK " << matches.size();
+        for (const auto &match : matches)
+            out << " " << match.term << ":" << match.distance << ":" << match.doc_count;
+        return out.str();
+    }
+
+    // The answer to CACHE
+    inline std::string cache_stats(const BlockCache::Stats &stats)
+    {
+        std::ostringstream out;
+        out << "OK " << stats.hits << " " << stats.misses << " " << stats.evictions << " "
+            << stats.overflows << " " << stats.bytes_read;
+        return out.str();
+    }
+
+    // The answer to BUDGET
+    inline std::string budget_stats(const BudgetStats &stats)
+    {
+        std::ostringstream out;
+        out << "OK " << stats.queries << " " << stats.over_time << " " << stats.over_work << " "
+            << stats.cancelled << " " << stats.partial << " " << stats.aborted;
+        return out.str();
+    }
+
+    // The answer to a query: its docs' external IDs, ascending
+    inline std::string doc_list(Indexer &indexer, std::vector<unsigned> docs)
+    {
+        for (auto &ID : docs)
+            ID = indexer.external_ID(ID);
+        std::sort(docs.begin(), docs.end());
+
+        std::ostringstream out;
+        out << "OK " << docs.size();
+        for (const auto &ID : docs)
+            out << " " << ID;
+        return out.str();
+    }
+
+    inline std::string answer(Indexer &indexer, const std::string &request)
+    {
+        if (request == "CACHE")
+            return cache_stats(indexer.cache_stats());
+        if (request == "BUDGET")
+            return budget_stats(indexer.budget_stats());
+        std::vector<std::string> postfix;
+        unsigned k;
+        std::string query;
+        bool partial;
+        if (split_deadline(request, k, partial, query))
+        {
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            QueryBudget budget(k, 0, partial ? QueryBudget::PARTIAL : QueryBudget::ABORT);
+            auto result = indexer.query_eval(postfix, &budget);
+            if (!result.second)
+                return budget.exceeded() ? "ERR over deadline" : "ERR incorrect query";
+            return doc_list(indexer, result.first) + (budget.exceeded() ? " PARTIAL" : "");
+        }
+        if (split_mode(request, "SUGGEST", query))
+        {
+            const std::string word = suggest_word(query);
+            if (word.empty())
+                return "ERR incorrect word";
+            return suggestions(indexer.suggest(word));
+        }
+        if (split_snippet(request, k, query))
+        {
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            const unsigned ID = indexer.stored_ID(k);
+            if (!ID)
+                return "ERR unknown doc";
+            return "OK " + indexer.stored().path(ID) + " " + indexer.snippet(ID, postfix);
+        }
+        if (split_top(request, k, query))
+        {
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            auto ranked = indexer.ranked_eval(postfix, k);
+            if (!ranked.second)
+                return "ERR incorrect query";
+            std::ostringstream out;
+            out << "OK " << ranked.first.size();
+            for (const auto &doc : ranked.first)
+                out << " " << indexer.external_ID(doc.second) << ":" << doc.first;
+            return out.str();
+        }
+
+        std::string token;
+        if (split_page(request, k, token, query))
+        {
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            auto page = token == "-" ? indexer.query(postfix, k) : indexer.resume(postfix, k, token);
+            if (!page.second)
+                return "ERR incorrect query or token";
+            std::ostringstream out;
+            out << "OK " << page.first.docs.size();
+            for (const auto &ID : page.first.docs)
+                out << " " << indexer.external_ID(ID);
+            out << " " << (page.first.token.empty() ? "-" : page.first.token);
+            return out.str();
+        }
+
+        const bool count = split_mode(request, "COUNT", query);
+        if (count || split_mode(request, "EXISTS", query))
+        {
+            if (!parse_query(query, postfix))
+                return "ERR incorrect query";
+            if (count)
+            {
+                auto counted = indexer.count(postfix);
+                return counted.second ? "OK " + std::to_string(counted.first) : "ERR incorrect query";
+            }
+            auto found = indexer.exists(postfix);
+            return found.second ? std::string(found.first ? "OK 1" : "OK 0") : "ERR incorrect query";
+        }
+
+        const bool fuzzy = split_mode(request, "FUZZY", query);
+        const bool explain = !fuzzy && request.compare(0, 8, "EXPLAIN ") == 0;
+        if (!parse_query(fuzzy ? query : explain ? request.substr(8) : request, postfix))
+            return "ERR incorrect query";
+        if (fuzzy)
+            indexer.expand_fuzzy(postfix);
+
+        if (explain)
+        {
+            std::string json = indexer.explain(postfix, true, true);
+            json.pop_back(); // the trailing '\n'
+            return "OK " + json;
+        }
+
+        auto result = indexer.query_eval(postfix);
+        if (!result.second)
+            return "ERR incorrect query";
+        return doc_list(indexer, result.first);
+    }
+
+    // Reads the doc IDs of an "OK" answer; returns false for "ERR"
+    inline bool read_answer(const std::string &response, std::vector<unsigned> &docs)
+    {
+        docs.clear();
+        if (response.compare(0, 3, "OK ") != 0)
+            return false;
+        std::istringstream in(response.substr(3));
+        unsigned count, ID;
+        if (!(in >> count))
+            return false;
+        while (docs.size() < count && in >> ID)
+            docs.push_back(ID);
+        return docs.size() == count;
+    }
+
+    // Reads the doc IDs and token of an "OK" answer to PAGE; returns false for "ERR"
+    inline bool read_page(const std::string &response, std::vector<unsigned> &docs, std::string &token)
+    {
+        if (!read_answer(response, docs))
+            return false;
+        token = response.substr(response.rfind(' ') + 1);
+        return true;
+    }
+
+    // Reads the number of an "OK" answer to COUNT or EXISTS; returns false for "ERR"
+    inline bool read_count(const std::string &response, unsigned long long &count)
+    {
+        if (response.compare(0, 3, "OK ") != 0)
+            return false;
+        std::istringstream in(response.substr(3));
+        return bool(in >> count);
+    }
+
+    // Reads an "OK" answer to CACHE; returns false for "ERR"
+    inline bool read_cache_stats(const std::string &response, BlockCache::Stats &stats)
+    {
+        if (response.compare(0, 3, "OK ") != 0)
+            return false;
+        std::istringstream in(response.substr(3));
+        return bool(in >> stats.hits >> stats.misses >> stats.evictions >> stats.overflows >> stats.bytes_read);
+    }
+
+    // Reads an "OK" answer to BUDGET; returns false for "ERR"
+    inline bool read_budget_stats(const std::string &response, BudgetStats &stats)
+    {
+        if (response.compare(0, 3, "OK ") != 0)
+            return false;
+        std::istringstream in(response.substr(3));
+        return bool(in >> stats.queries >> stats.over_time >> stats.over_work >> stats.cancelled >>
+                    stats.partial >> stats.aborted);
+    }
+
+    // True if an "OK" answer to DEADLINE holds only the docs found before the deadline
+    inline bool is_partial(const std::string &response)
+    {
+        return response.size() >= 8 && response.compare(response.size() - 8, 8, " PARTIAL") == 0;
+    }
+
+    // Reads the terms of an "OK" answer to SUGGEST; returns false for "ERR"
+    inline bool read_suggestions(const std::string &response, std::vector<Trie::Match> &matches)
+    {
+        matches.clear();
+        if (response.compare(0, 3, "OK ") != 0)
+            return false;
+        std::istringstream in(response.substr(3));
+        unsigned count;
+        std::string item;
+        if (!(in >> count))
+            return false;
+        while (matches.size() < count && in >> item)
+        {
+            const size_t first = item.find(':'), second = item.rfind(':');
+            if (first == std::string::npos || first == second)
+                return false;
+            Trie::Match match;
+            match.term = item.substr(0, first);
+            match.distance = std::stoul(item.substr(first + 1, second - first - 1));
+            match.doc_count = std::stoul(item.substr(second + 1));
+            matches.push_back(match);
+        }
+        return matches.size() == count;
+    }
+
+    // Reads the (score, doc ID) pairs of an "OK" answer to TOP; returns false for "ERR"
+    inline bool read_ranked(const std::string &response, std::vector<std::pair<unsigned, unsigned>> &docs)
+    {
+        docs.clear();
+        if (response.compare(0, 3, "OK ") != 0)
+            return false;
+        std::istringstream in(response.substr(3));
+        unsigned count, ID, score;
+        char colon;
+        if (!(in >> count))
+            return false;
+        while (docs.size() < count && in >> ID >> colon >> score)
+            docs.emplace_back(score, ID);
+        return docs.size() == count;
+    }
+}
+
+#endif
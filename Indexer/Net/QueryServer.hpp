@@ -0,0 +1,63 @@
+#pragma once
+#ifndef QUERY_SERVER_HPP
+#define QUERY_SERVER_HPP
+
+#include "UnixSocket.hpp"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <sys/socket.h>
+
+// Serves one request line -> one response line over a Unix socket
+// Every connection gets its own thread, so the handler must be thread safe
+class QueryServer
+{
+public:
+    using Handler = std::function<std::string(const std::string &request)>;
+
+    QueryServer(Handler handler)
+        : handler(std::move(handler)) {}
+
+    // Blocks until stop() is called; returns false if path cannot be listened on
+    bool serve(const std::string &path)
+    {
+        listener = LineSocket::listen_on(path);
+        if (listener < 0)
+            return false;
+
+        while (!stopping)
+        {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            std::thread([this, fd]()
+            {
+                LineSocket client(fd);
+                std::string request;
+                while (client.read_line(request))
+                {
+                    if (!client.write_line(handler(request)))
+                        break;
+                }
+            }).detach();
+        }
+        ::close(listener);
+        unlink(path.c_str());
+        return true;
+    }
+
+    void stop()
+    {
+        stopping = true;
+        if (listener >= 0)
+            shutdown(listener, SHUT_RDWR); // wakes up accept()
+    }
+
+private:
+    Handler handler;
+    std::atomic<bool> stopping{false};
+    int listener{-1};
+};
+
+#endif
@@ -0,0 +1,158 @@
+#pragma once
+#ifndef UNIX_SOCKET_HPP
+#define UNIX_SOCKET_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A connected stream socket that exchanges '\n' terminated lines
+class LineSocket
+{
+public:
+    LineSocket(const int &fd = -1)
+        : fd(fd) {}
+    LineSocket(const LineSocket &) = delete;
+    LineSocket &operator=(const LineSocket &) = delete;
+
+    LineSocket(LineSocket &&other)
+        : fd(other.fd), buffer(std::move(other.buffer))
+    {
+        other.fd = -1;
+    }
+
+    LineSocket &operator=(LineSocket &&other)
+    {
+        if (this != &other)
+        {
+            close();
+            fd = other.fd;
+            buffer = std::move(other.buffer);
+            other.fd = -1;
+        }
+        return *this;
+    }
+
+    ~LineSocket()
+    {
+        close();
+    }
+
+    // Returns an unconnected socket (is_open() false) on failure
+    static LineSocket connect_to(const std::string &path)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return LineSocket();
+        sockaddr_un address = make_address(path);
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+        {
+            ::close(fd);
+            return LineSocket();
+        }
+        return LineSocket(fd);
+    }
+
+    // Returns the listening fd or -1; an old socket file at path is replaced
+    static int listen_on(const std::string &path, const int &backlog = 64)
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        unlink(path.c_str());
+        sockaddr_un address = make_address(path);
+        if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || listen(fd, backlog) < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool is_open() const { return fd >= 0; }
+    int descriptor() const { return fd; }
+
+    // Reads one line without its '\n'; returns false once the peer is gone
+    bool read_line(std::string &line)
+    {
+        size_t end;
+        while ((end = buffer.find('\n')) == std::string::npos)
+        {
+            char chunk[4096];
+            ssize_t got = read(fd, chunk, sizeof(chunk));
+            if (got <= 0)
+                return false;
+            buffer.append(chunk, got);
+        }
+        line.assign(buffer, 0, end);
+        buffer.erase(0, end + 1);
+        return true;
+    }
+
+    // Same as read_line() but gives up (returning false) once deadline has passed
+    // The rest of a late line stays in the buffer, so close the socket after a timeout
+    bool read_line(std::string &line, const std::chrono::steady_clock::time_point &deadline)
+    {
+        size_t end;
+        while ((end = buffer.find('\n')) == std::string::npos)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - std::chrono::steady_clock::now()).count();
+            pollfd waiting{fd, POLLIN, 0};
+            if (poll(&waiting, 1, std::max<long long>(left, 0)) <= 0) // a line that is already there is still read
+                return false;
+            char chunk[4096];
+            ssize_t got = read(fd, chunk, sizeof(chunk));
+            if (got <= 0)
+                return false;
+            buffer.append(chunk, got);
+        }
+        line.assign(buffer, 0, end);
+        buffer.erase(0, end + 1);
+        return true;
+    }
+
+    // Sends line followed by '\n'
+    bool write_line(const std::string &line)
+    {
+        std::string out = line + "\n";
+        const char *it = out.data();
+        size_t left = out.size();
+        while (left)
+        {
+            ssize_t sent = send(fd, it, left, MSG_NOSIGNAL);
+            if (sent <= 0)
+                return false;
+            it += sent;
+            left -= sent;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+
+private:
+    int fd{-1};
+    std::string buffer; // bytes read past the last line
+
+    static sockaddr_un make_address(const std::string &path)
+    {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        return address;
+    }
+};
+
+#endif
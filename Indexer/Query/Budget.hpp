@@ -0,0 +1,214 @@
+#pragma once
+#ifndef BUDGET_HPP
+#define BUDGET_HPP
+
+#include "Cursor.hpp"
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+// A limit on how long one query may run: a time, a number of posting entries
+// (and result docs) to step over, or both, plus cancel() to stop it from another thread
+// It is checked cooperatively: every leaf of the query's cursor tree is wrapped in a
+// BudgetCursor that charges what it steps over and ends its list once the budget is
+// spent, so every operator above it finishes quickly too; the clock is read only
+// every check_every postings
+// Several threads may charge one budget, as the ranges of a parallel query do
+class QueryBudget
+{
+public:
+    enum Policy
+    {
+        ABORT,  // a query over its budget fails
+        PARTIAL // a query over its budget returns the docs it found, flagged as partial
+    };
+
+    enum Reason
+    {
+        NONE,
+        TIME,
+        WORK,
+        CANCELLED
+    };
+
+    const static unsigned long long check_every = 1024;
+
+    // 0 means no limit of that kind; the clock starts now
+    QueryBudget(const unsigned &time_ms, const unsigned long long &max_work = 0, const Policy &policy = ABORT)
+        : policy(policy), limit(max_work), timed(time_ms > 0),
+          deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(time_ms)) {}
+
+    QueryBudget(const QueryBudget &) = delete;
+    QueryBudget &operator=(const QueryBudget &) = delete;
+
+    // May be called from any thread
+    void cancel()
+    {
+        stop(CANCELLED);
+    }
+
+    // Charges work steps; true once the budget is spent
+    bool charge(const unsigned long long &work)
+    {
+        if (stopped.load(std::memory_order_relaxed) != NONE)
+            return true;
+        const unsigned long long before = spent.fetch_add(work, std::memory_order_relaxed);
+        if (limit && before + work > limit)
+            stop(WORK);
+        else if (timed && (before / check_every != (before + work) / check_every || before == 0) &&
+                 std::chrono::steady_clock::now() >= deadline)
+            stop(TIME);
+        return exceeded();
+    }
+
+    bool exceeded() const
+    {
+        return stopped.load(std::memory_order_relaxed) != NONE;
+    }
+
+    Reason reason() const
+    {
+        return stopped.load(std::memory_order_relaxed);
+    }
+
+    unsigned long long work() const
+    {
+        return spent.load(std::memory_order_relaxed);
+    }
+
+    const Policy policy;
+
+private:
+    const unsigned long long limit;
+    const bool timed;
+    const std::chrono::steady_clock::time_point deadline;
+    std::atomic<unsigned long long> spent{0};
+    std::atomic<Reason> stopped{NONE};
+
+    // The first reason sticks
+    void stop(const Reason &why)
+    {
+        Reason none = NONE;
+        stopped.compare_exchange_strong(none, why, std::memory_order_relaxed);
+    }
+};
+
+// How the budgeted queries of an index went
+struct BudgetStats
+{
+    unsigned long long queries{0}; // queries run with a budget
+    unsigned long long over_time{0};
+    unsigned long long over_work{0};
+    unsigned long long cancelled{0};
+    unsigned long long partial{0}; // of those over budget, the ones that returned what they had
+    unsigned long long aborted{0}; // and the ones that failed
+
+    void print(std::ostream &out) const
+    {
+        out << "Budgets: " << queries << " queries, " << over_time << " over time, " << over_work
+            << " over work, " << cancelled << " cancelled; " << partial << " partial, " << aborted << " aborted\n";
+    }
+};
+
+// Counts into BudgetStats from any number of threads
+class BudgetCounters
+{
+public:
+    void record(const QueryBudget &budget)
+    {
+        queries++;
+        switch (budget.reason())
+        {
+        case QueryBudget::NONE: return;
+        case QueryBudget::TIME: over_time++; break;
+        case QueryBudget::WORK: over_work++; break;
+        default: cancelled++; break;
+        }
+        (budget.policy == QueryBudget::PARTIAL ? partial : aborted)++;
+    }
+
+    BudgetStats stats() const
+    {
+        BudgetStats now;
+        now.queries = queries;
+        now.over_time = over_time;
+        now.over_work = over_work;
+        now.cancelled = cancelled;
+        now.partial = partial;
+        now.aborted = aborted;
+        return now;
+    }
+
+private:
+    std::atomic<unsigned long long> queries{0}, over_time{0}, over_work{0}, cancelled{0}, partial{0}, aborted{0};
+};
+
+// Wraps a leaf cursor and charges its steps to a budget; once the budget is
+// spent it acts as if its list had ended
+class BudgetCursor : public PostingCursor
+{
+public:
+    BudgetCursor(CursorPtr inner, QueryBudget &budget)
+        : inner(std::move(inner)), budget(budget)
+    {
+        check();
+    }
+
+    unsigned doc() const override
+    {
+        return done ? NO_MORE_DOCS : inner->doc();
+    }
+
+    unsigned next() override
+    {
+        if (done)
+            return NO_MORE_DOCS;
+        inner->next();
+        return check();
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (done)
+            return NO_MORE_DOCS;
+        inner->advance_to(target);
+        return check();
+    }
+
+    unsigned cost() const override
+    {
+        return done ? 0 : inner->cost();
+    }
+
+    unsigned long long scanned() const override
+    {
+        return inner->scanned();
+    }
+
+private:
+    const static unsigned charge_every = 64; // steps charged at once, so leaves share the counter less often
+
+    CursorPtr inner;
+    QueryBudget &budget;
+    unsigned long long charged{0}; // inner->scanned() when last checked
+    unsigned long long pending{0}; // steps not charged yet
+    bool done{false};
+
+    // Counts the entries stepped over since the last call, and the call itself
+    unsigned check()
+    {
+        const unsigned long long now = inner->scanned();
+        pending += now - charged + 1;
+        charged = now;
+        if (pending >= charge_every)
+        {
+            done = budget.charge(pending);
+            pending = 0;
+        }
+        else
+            done = budget.exceeded(); // spent by another leaf, or cancelled
+        return doc();
+    }
+};
+
+#endif
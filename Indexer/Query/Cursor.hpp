@@ -0,0 +1,744 @@
+#pragma once
+#ifndef CURSOR_HPP
+#define CURSOR_HPP
+#define NO_MORE_DOCS (~0u)
+
+#include "../Extensions/Posting.hpp"
+#include "../Storage/DiskPostings.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// A document-at-a-time iterator over an ascending list of doc IDs
+// A cursor is positioned on its first doc as soon as it is constructed
+// doc() returns NO_MORE_DOCS once the cursor is exhausted
+class PostingCursor
+{
+public:
+    virtual ~PostingCursor() = default;
+
+    // The doc the cursor is currently on
+    virtual unsigned doc() const = 0;
+
+    // Moves to the next doc and returns it
+    virtual unsigned next() = 0;
+
+    // Moves to the first doc >= target and returns it
+    // Never moves backwards
+    virtual unsigned advance_to(const unsigned &target) = 0;
+
+    // Upper bound on the number of docs the cursor can still produce
+    virtual unsigned cost() const = 0;
+
+    // Posting entries this cursor itself has stepped over (children not included)
+    virtual unsigned long long scanned() const { return 0; }
+
+    // Counts the docs from the current one up to limit and moves past them
+    // Operators that can count without visiting every doc override this
+    virtual unsigned long long count_to(const unsigned &limit)
+    {
+        unsigned long long n = 0;
+        for (unsigned d = doc(); d <= limit && d != NO_MORE_DOCS; d = next())
+            n++;
+        return n;
+    }
+
+    // Sets bit d - base of bits for every doc d in base..end and moves to the first doc after end
+    // bits must hold end - base + 1 bits, cleared by the caller
+    virtual void mark(uint64_t *bits, const unsigned &base, const unsigned &end)
+    {
+        for (unsigned d = advance_to(base); d <= end; d = next())
+            bits[(d - base) / 64] |= uint64_t(1) << ((d - base) % 64);
+    }
+};
+
+using CursorPtr = std::unique_ptr<PostingCursor>;
+
+// Walks the documents of a single term
+// advance_to() jumps over long stretches through the posting's skips
+// Docs above last are never visited, so a posting may be appended to while it is read
+// A disk-resident posting (see Storage/DiskPostings.hpp) is read in place from the
+// cache block the cursor is on, which stays pinned until the cursor moves off it;
+// a block that cannot be read ends the cursor early and sets *failed, so the query
+// can fail rather than answer from a list cut short
+class TermCursor : public PostingCursor
+{
+public:
+    // posting may be null if the term is not in the dictionary
+    TermCursor(const Posting *posting, const unsigned &last = NO_MORE_DOCS - 1,
+               std::atomic<bool> *failed = nullptr)
+        : it(posting ? posting->documents.begin() : nullptr),
+          skips(posting ? &posting->skips : nullptr),
+          run(posting ? posting->disk : nullptr),
+          count(posting ? observe(posting->doc_count) : 0),
+          last(last), failed(failed)
+    {
+        if (run)
+        {
+            positions = run->positions;
+            load();
+        }
+        clip();
+    }
+
+    unsigned doc() const override
+    {
+        return it ? it->data.ID : pair ? pair[0] : NO_MORE_DOCS;
+    }
+
+    unsigned next() override
+    {
+        if (it)
+        {
+            it = observe(it->next);
+            at++;
+            steps++;
+            clip();
+        }
+        else if (pair)
+        {
+            step();
+            clip();
+        }
+        return doc();
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        jump(target);
+        while (it && it->data.ID < target && it->data.ID <= last)
+        {
+            it = observe(it->next);
+            at++;
+            steps++;
+        }
+        while (pair && pair[0] < target && pair[0] <= last)
+            step();
+        clip();
+        return doc();
+    }
+
+    // Jumps through the skips to the last one at or below limit, then walks
+    // the few docs after it; doc_count alone is not enough, because a posting
+    // may hold docs above last that a writer is still adding
+    unsigned long long count_to(const unsigned &limit) override
+    {
+        const unsigned bound = std::min(limit, last);
+        if (doc() > bound)
+            return 0;
+        const unsigned long long from = at;
+        jump(bound);
+        while (it && it->data.ID <= bound)
+        {
+            it = observe(it->next);
+            at++;
+            steps++;
+        }
+        while (pair && pair[0] <= bound)
+            step();
+        clip();
+        return at - from;
+    }
+
+    void mark(uint64_t *bits, const unsigned &base, const unsigned &end) override
+    {
+        advance_to(base);
+        const unsigned bound = std::min(end, last);
+        while (it && it->data.ID <= bound)
+        {
+            const unsigned d = it->data.ID - base;
+            bits[d / 64] |= uint64_t(1) << (d % 64);
+            it = observe(it->next);
+            at++;
+            steps++;
+        }
+        while (pair && pair[0] <= bound)
+        {
+            const unsigned d = pair[0] - base;
+            bits[d / 64] |= uint64_t(1) << (d % 64);
+            step();
+        }
+        clip();
+    }
+
+    unsigned cost() const override
+    {
+        return count;
+    }
+
+    // The doc the cursor is on, with its term frequency and positions; null when exhausted
+    // For a disk-resident posting it is only valid until the cursor moves
+    const Document *document() const
+    {
+        if (it)
+            return &it->data;
+        if (!pair)
+            return nullptr;
+        current.emplace(pair[0]);
+        current->term_freq = pair[1];
+        current->positions_offset = positions;
+        return &*current;
+    }
+
+    unsigned long long scanned() const override
+    {
+        return steps;
+    }
+
+private:
+    // Docs above last do not exist for this cursor
+    void clip()
+    {
+        if (it && it->data.ID > last)
+            it = nullptr;
+        if (pair && pair[0] > last)
+        {
+            pair = nullptr;
+            block.release();
+        }
+    }
+
+    // Moves to the last skip whose doc is at most target, if it is ahead of us
+    void jump(const unsigned &target)
+    {
+        if (run)
+        {
+            const size_t skip_count = run->skips.size();
+            if (!pair || pair[0] >= target || skip_at >= skip_count)
+                return;
+            auto after = std::upper_bound(run->skips.begin() + skip_at, run->skips.end(), target,
+                                          [](const unsigned &t, const std::pair<unsigned, unsigned long long> &skip)
+                                          { return t < skip.first; });
+            const size_t k = after - run->skips.begin();
+            if (k > skip_at && run->skips[k - 1].first > pair[0])
+            {
+                at = k * DISK_SKIP; // skip k - 1 is pair k * DISK_SKIP
+                positions = run->skips[k - 1].second;
+                steps++;
+                load();
+            }
+            skip_at = std::max(skip_at, k);
+            return;
+        }
+        const size_t skip_count = skips ? skips->size() : 0;
+        if (!it || it->data.ID >= target || skip_at >= skip_count)
+            return;
+        Node<Document> *const *jumps = skips->data();
+        auto after = std::upper_bound(jumps + skip_at, jumps + skip_count, target,
+                                      [](const unsigned &t, const Node<Document> *node)
+                                      { return t < node->data.ID; });
+        const size_t k = after - jumps;
+        if (k > skip_at && jumps[k - 1]->data.ID > it->data.ID)
+        {
+            it = jumps[k - 1];
+            at = k * SKIP_INTERVAL; // skip k - 1 is the doc at k * SKIP_INTERVAL
+            steps++;
+        }
+        skip_at = std::max(skip_at, k);
+    }
+
+    // Points pair at pair number at of a disk-resident posting, pinning its block
+    // Pairs never straddle blocks, whose size is a multiple of 8 bytes
+    void load()
+    {
+        pair = nullptr;
+        if (at >= count)
+        {
+            block.release();
+            return;
+        }
+        const unsigned long long byte = (run->entry + at) * 2 * sizeof(unsigned);
+        const unsigned long long number = byte / run->cache->block_size();
+        if (!block.holds(run->file, number))
+            block = run->cache->pin(run->file, number);
+        const unsigned long long in = byte - number * run->cache->block_size();
+        if (block && in + 2 * sizeof(unsigned) <= block.size())
+            pair = reinterpret_cast<const unsigned *>(block.data() + in);
+        else if (failed)
+            failed->store(true, std::memory_order_relaxed);
+    }
+
+    // The next pair of a disk-resident posting
+    void step()
+    {
+        positions += pair[1];
+        at++;
+        steps++;
+        pair += 2;
+        if (at >= count || reinterpret_cast<const char *>(pair) >= block.data() + block.size())
+            load();
+    }
+
+    Node<Document> *it{0};
+    unsigned long long at{0}; // how many docs of the posting are before it
+    const AppendOnlyArray<Node<Document> *> *skips{0};
+    size_t skip_at{0}; // skips before this one are behind the cursor
+    const DiskRun *run{0};
+    BlockCache::Pin block;           // of a disk-resident posting: the block pair is in
+    const unsigned *pair{0};         // its (doc ID, term freq) at
+    unsigned long long positions{0}; // where that doc's positions start
+    mutable std::optional<Document> current; // what document() shows of it
+    unsigned count{0};
+    unsigned last{NO_MORE_DOCS - 1};
+    std::atomic<bool> *failed{0}; // set if a block of the posting cannot be read
+    unsigned long long steps{0};
+};
+
+// Intersection of its children
+// Children are leapfrogged from the cheapest one
+class AndCursor : public PostingCursor
+{
+public:
+    AndCursor(std::vector<CursorPtr> children)
+        : children(std::move(children))
+    {
+        std::sort(this->children.begin(), this->children.end(),
+                  [](const CursorPtr &a, const CursorPtr &b)
+                  { return a->cost() < b->cost(); });
+        align(this->children.front()->doc());
+    }
+
+    unsigned doc() const override
+    {
+        return current;
+    }
+
+    unsigned next() override
+    {
+        if (current == NO_MORE_DOCS)
+            return current;
+        return align(children.front()->next());
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (current >= target)
+            return current;
+        return align(children.front()->advance_to(target));
+    }
+
+    unsigned cost() const override
+    {
+        return children.front()->cost();
+    }
+
+    // Children of about the same size are intersected WINDOW docs at a time as bitmaps:
+    // every child marks its docs, the bitmaps are ANDed and the bits that are left counted
+    // If one child is much smaller, leapfrogging from it skips most of the others instead
+    unsigned long long count_to(const unsigned &limit) override
+    {
+        if (current > limit)
+            return 0;
+        if (children.back()->cost() > DENSE_RATIO * (unsigned long long)children.front()->cost())
+            return PostingCursor::count_to(limit);
+
+        uint64_t bits[WINDOW / 64], other[WINDOW / 64];
+        unsigned long long n = 0;
+        unsigned base = current;
+        while (base <= limit)
+        {
+            const unsigned end = limit - base < WINDOW - 1 ? limit : base + WINDOW - 1;
+            memset(bits, 0, sizeof(bits));
+            children[0]->mark(bits, base, end);
+            for (size_t i = 1; i < children.size(); i++)
+            {
+                memset(other, 0, sizeof(other));
+                children[i]->mark(other, base, end);
+                for (unsigned w = 0; w < WINDOW / 64; w++)
+                    bits[w] &= other[w];
+            }
+            for (unsigned w = 0; w < WINDOW / 64; w++)
+                n += __builtin_popcountll(bits[w]);
+            // No doc before the child that is furthest ahead can be in all of them
+            base = furthest();
+        }
+
+        // Back to a doc all the children share, as if next() had been called all along
+        children.front()->advance_to(furthest());
+        align(children.front()->doc());
+        return n;
+    }
+
+private:
+    static const unsigned WINDOW = 1 << 12; // docs per bitmap
+    static const unsigned DENSE_RATIO = 8;  // largest child / smallest child for bitmaps
+
+    std::vector<CursorPtr> children;
+    unsigned current{NO_MORE_DOCS};
+
+    unsigned furthest() const
+    {
+        unsigned d = 0;
+        for (const auto &child : children)
+            d = std::max(d, child->doc());
+        return d;
+    }
+
+    // Moves every child to the first doc >= target that all of them share
+    unsigned align(unsigned target)
+    {
+        const size_t n = children.size();
+        size_t agreed = 1; // how many children are known to sit on target
+        size_t i = 1 % n;
+        while (target != NO_MORE_DOCS && agreed < n)
+        {
+            unsigned d = children[i]->advance_to(target);
+            if (d == target)
+                agreed++;
+            else
+            {
+                target = d;
+                agreed = 1;
+            }
+            i = (i + 1) % n;
+        }
+        current = target;
+        return current;
+    }
+};
+
+// Union of its children
+class OrCursor : public PostingCursor
+{
+public:
+    OrCursor(std::vector<CursorPtr> children)
+        : children(std::move(children))
+    {
+        update();
+    }
+
+    unsigned doc() const override
+    {
+        return current;
+    }
+
+    unsigned next() override
+    {
+        if (current == NO_MORE_DOCS)
+            return current;
+        for (auto &child : children)
+        {
+            if (child->doc() == current)
+                child->next();
+        }
+        return update();
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (current >= target)
+            return current;
+        for (auto &child : children)
+            child->advance_to(target);
+        return update();
+    }
+
+    unsigned cost() const override
+    {
+        unsigned total = 0;
+        for (const auto &child : children)
+            total += child->cost();
+        return total;
+    }
+
+private:
+    std::vector<CursorPtr> children;
+    unsigned current{NO_MORE_DOCS};
+
+    // The current doc is the smallest doc among the children
+    unsigned update()
+    {
+        current = NO_MORE_DOCS;
+        for (const auto &child : children)
+            current = std::min(current, child->doc());
+        return current;
+    }
+};
+
+// Complement of its child over the doc IDs min_doc..max_doc
+class NotCursor : public PostingCursor
+{
+public:
+    NotCursor(CursorPtr child, const unsigned &max_doc, const unsigned &min_doc = 1)
+        : child(std::move(child)), max_doc(max_doc), min_doc(min_doc)
+    {
+        skip(min_doc);
+    }
+
+    unsigned doc() const override
+    {
+        return current;
+    }
+
+    unsigned next() override
+    {
+        if (current == NO_MORE_DOCS)
+            return current;
+        return skip(current + 1);
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (current >= target)
+            return current;
+        return skip(target);
+    }
+
+    unsigned cost() const override
+    {
+        return max_doc + 1 - min_doc;
+    }
+
+    // The docs in range less the child's docs in it
+    unsigned long long count_to(const unsigned &limit) override
+    {
+        const unsigned last = std::min(limit, max_doc);
+        if (current > last)
+            return 0;
+        const unsigned long long n = last - current + 1ull - child->count_to(last);
+        skip(last + 1);
+        return n;
+    }
+
+private:
+    CursorPtr child;
+    unsigned max_doc{0};
+    unsigned min_doc{1};
+    unsigned current{NO_MORE_DOCS};
+
+    // Moves to the first doc >= target that the child does not contain
+    unsigned skip(unsigned target)
+    {
+        while (target <= max_doc && child->advance_to(target) == target)
+            target++;
+        current = target <= max_doc ? target : NO_MORE_DOCS;
+        return current;
+    }
+};
+
+// Docs of include that are not in exclude (include AND NOT exclude)
+// Cheaper than intersecting with a complement: exclude is only probed
+class AndNotCursor : public PostingCursor
+{
+public:
+    AndNotCursor(CursorPtr include, CursorPtr exclude)
+        : include(std::move(include)), exclude(std::move(exclude))
+    {
+        skip(this->include->doc());
+    }
+
+    unsigned doc() const override
+    {
+        return current;
+    }
+
+    unsigned next() override
+    {
+        if (current == NO_MORE_DOCS)
+            return current;
+        return skip(include->next());
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (current >= target)
+            return current;
+        return skip(include->advance_to(target));
+    }
+
+    unsigned cost() const override
+    {
+        return include->cost();
+    }
+
+private:
+    CursorPtr include;
+    CursorPtr exclude;
+    unsigned current{NO_MORE_DOCS};
+
+    unsigned skip(unsigned target)
+    {
+        while (target != NO_MORE_DOCS && exclude->advance_to(target) == target)
+            target = include->next();
+        current = target;
+        return current;
+    }
+};
+
+// Union of many children, kept in a min-heap on their current doc
+// Cheaper than OrCursor once there are more than a handful of children
+class HeapOrCursor : public PostingCursor
+{
+public:
+    HeapOrCursor(std::vector<CursorPtr> children)
+        : children(std::move(children))
+    {
+        for (auto &child : this->children)
+            total += child->cost();
+        std::make_heap(this->children.begin(), this->children.end(), later);
+        current = this->children.empty() ? NO_MORE_DOCS : this->children.front()->doc();
+    }
+
+    unsigned doc() const override
+    {
+        return current;
+    }
+
+    unsigned next() override
+    {
+        if (current == NO_MORE_DOCS)
+            return current;
+        return advance_to(current + 1);
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (current >= target)
+            return current;
+        // Move every child that is behind target, fixing the heap as we go
+        while (children.front()->doc() < target)
+        {
+            std::pop_heap(children.begin(), children.end(), later);
+            children.back()->advance_to(target);
+            std::push_heap(children.begin(), children.end(), later);
+        }
+        current = children.front()->doc();
+        return current;
+    }
+
+    unsigned cost() const override
+    {
+        return total;
+    }
+
+private:
+    std::vector<CursorPtr> children;
+    unsigned current{NO_MORE_DOCS};
+    unsigned total{0};
+
+    static bool later(const CursorPtr &a, const CursorPtr &b)
+    {
+        return a->doc() > b->doc();
+    }
+};
+
+// The docs of its child within first..last
+// Lets one plan be evaluated over disjoint doc ranges at the same time
+class RangeCursor : public PostingCursor
+{
+public:
+    RangeCursor(CursorPtr child, const unsigned &first, const unsigned &last)
+        : child(std::move(child)), last(last)
+    {
+        clip(this->child->advance_to(first));
+    }
+
+    unsigned doc() const override
+    {
+        return current;
+    }
+
+    unsigned next() override
+    {
+        if (current == NO_MORE_DOCS)
+            return current;
+        return clip(child->next());
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (current >= target)
+            return current;
+        return clip(child->advance_to(target));
+    }
+
+    unsigned cost() const override
+    {
+        return child->cost();
+    }
+
+    unsigned long long count_to(const unsigned &limit) override
+    {
+        if (current == NO_MORE_DOCS)
+            return 0;
+        const unsigned long long n = child->count_to(std::min(limit, last));
+        clip(child->doc());
+        return n;
+    }
+
+private:
+    CursorPtr child;
+    unsigned last{0};
+    unsigned current{NO_MORE_DOCS};
+
+    unsigned clip(const unsigned &d)
+    {
+        current = d <= last ? d : NO_MORE_DOCS;
+        return current;
+    }
+};
+
+// Walks an already materialized, ascending list of doc IDs
+// The list is shared so the same result can be read by several cursors
+class ListCursor : public PostingCursor
+{
+public:
+    ListCursor(std::shared_ptr<const std::vector<unsigned>> docs)
+        : docs(std::move(docs)) {}
+
+    unsigned doc() const override
+    {
+        return i < docs->size() ? (*docs)[i] : NO_MORE_DOCS;
+    }
+
+    unsigned next() override
+    {
+        if (i < docs->size())
+        {
+            i++;
+            steps++;
+        }
+        return doc();
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (i < docs->size() && (*docs)[i] < target)
+        {
+            size_t from = i;
+            i = std::lower_bound(docs->begin() + i, docs->end(), target) - docs->begin();
+            steps += i - from;
+        }
+        return doc();
+    }
+
+    unsigned cost() const override
+    {
+        return docs->size() - std::min(i, docs->size());
+    }
+
+    unsigned long long count_to(const unsigned &limit) override
+    {
+        const size_t from = i;
+        i = std::upper_bound(docs->begin() + std::min(i, docs->size()), docs->end(), limit) - docs->begin();
+        steps += i - from;
+        return i - from;
+    }
+
+    unsigned long long scanned() const override
+    {
+        return steps;
+    }
+
+private:
+    std::shared_ptr<const std::vector<unsigned>> docs;
+    size_t i{0};
+    unsigned long long steps{0};
+};
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+#ifndef FUZZY_HPP
+#define FUZZY_HPP
+
+#include "../Tries/Trie.hpp"
+#include <string>
+#include <vector>
+
+// Spelling correction: a query term that is not indexed gives no docs, so a misspelled
+// term empties a whole AND; expand() swaps such a term for the indexed terms closest
+// to it (see Trie::fuzzy), ORed together
+namespace Fuzzy
+{
+    // Edits a word may be away from its corrections: a word of n characters
+    // gets at most n / 3, so short words are not replaced by unrelated ones
+    inline unsigned allowed(const std::string &word, const unsigned &max_distance)
+    {
+        return std::min<unsigned>(max_distance, word.length() / 3);
+    }
+
+    // Replaces every term of a postfix query that suggest(term) does not find
+    // (no match at distance 0) by an OR of up to limit of the closest matches it
+    // returns, which come first (see Trie::Match)
+    // Operators, phrases and terms without matches are kept
+    // Returns the number of terms replaced
+    template <typename Suggest>
+    unsigned expand(std::vector<std::string> &query, Suggest suggest, const size_t &limit = 3)
+    {
+        std::vector<std::string> expanded;
+        unsigned replaced = 0;
+        for (const auto &word : query)
+        {
+            if (word == "and" || word == "or" || word == "not" || word.find(' ') != std::string::npos)
+            {
+                expanded.push_back(word);
+                continue;
+            }
+            std::vector<Trie::Match> matches = suggest(word);
+            if (matches.empty() || matches.front().distance == 0)
+            {
+                expanded.push_back(word);
+                continue;
+            }
+            for (size_t i = 0; i < matches.size() && i < limit && matches[i].distance == matches[0].distance; i++)
+            {
+                expanded.push_back(matches[i].term);
+                if (i)
+                    expanded.push_back("or");
+            }
+            replaced++;
+        }
+        query = expanded;
+        return replaced;
+    }
+}
+
+#endif
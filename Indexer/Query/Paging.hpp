@@ -0,0 +1,57 @@
+#pragma once
+#ifndef PAGING_HPP
+#define PAGING_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Results handed out a page at a time
+// A page ends with a continuation token that says where the next page starts;
+// the token only fits the query it came from, and holds no state on the server,
+// so a client may come back with it whenever it likes
+// Docs come in index (internal ID) order, so docs added to a live index later
+// show up on later pages
+namespace Paging
+{
+    struct Page
+    {
+        std::vector<unsigned> docs;
+        std::string token; // empty on the last page
+    };
+
+    // FNV-1a over the words of a postfix query
+    inline unsigned long long fingerprint(const std::vector<std::string> &query)
+    {
+        unsigned long long hash = 14695981039346656037ull;
+        for (const auto &word : query)
+        {
+            for (const char &c : word)
+                hash = (hash ^ (unsigned char)c) * 1099511628211ull;
+            hash = (hash ^ ' ') * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // The token for resuming query after the doc after_doc
+    inline std::string token(const std::vector<std::string> &query, const unsigned &after_doc)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%016llx%08x", fingerprint(query), after_doc);
+        return text;
+    }
+
+    // Reads the doc a token resumes after
+    // Returns false if the token is malformed or belongs to another query
+    inline bool resume(const std::string &token, const std::vector<std::string> &query, unsigned &after_doc)
+    {
+        if (token.size() != 24 || token.find_first_not_of("0123456789abcdef") != std::string::npos)
+            return false;
+        if (std::stoull(token.substr(0, 16), nullptr, 16) != fingerprint(query))
+            return false;
+        after_doc = std::stoul(token.substr(16), nullptr, 16);
+        return true;
+    }
+}
+
+#endif
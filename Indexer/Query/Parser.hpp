@@ -0,0 +1,225 @@
+#pragma once
+#ifndef PARSER_HPP
+#define PARSER_HPP
+
+#include <string>
+#include <vector>
+
+// Turns an infix boolean query typed by a user into the postfix form
+// that Indexer::query_eval expects
+// A phrase in double quotes ("new york") becomes one term with spaces between its words
+
+// Returns a number denoting operator precedence
+inline int precedence(std::string& op)
+{
+    if (op == "not")
+        return 2;
+    else if (op == "and")
+        return 1;
+    else if (op == "or")
+        return 0;
+    else
+        return -1;
+}
+
+// Ensures that for every opening bracket, there is a closing bracket too
+// Brackets inside a quoted phrase do not count
+inline bool bracket_check(const std::string& s)
+{
+    std::vector<char> stack;
+    bool quoted = false;
+    for (const char& i: s)
+    {
+        if (i == '"')
+            quoted = !quoted;
+        else if (quoted)
+            continue;
+        else if (i == '(')
+            stack.push_back(i);
+        else if (i == ')')
+        {
+            if (!stack.size())
+                return false;
+            stack.pop_back();
+        }
+    }
+    return stack.empty();
+}
+
+// Removes excess NOTs since two consecutive NOTs cancel one another
+inline void remove_excess_nots(std::vector<std::string>& v)
+{
+    const unsigned len = v.size();
+    unsigned j = 0;
+    for (unsigned i = 0; i + 1 + j < len;)
+    {
+        if (v[i] == v[i + 1] && v[i] == "not")
+        {
+            v.erase(v.begin() + i, v.begin() + i + 2); // Remvove both NOTs
+            j += 2;
+            continue;
+        }
+        i++;
+    }
+}
+
+// Insert word
+inline bool insert_word(std::string& word, std::vector<std::string>& stack, std::vector<std::string>& postfix, short& a)
+{
+    if (word == "not") // operator
+    {
+        stack.push_back(word);
+        word.clear();
+        a = 2;
+    }
+    else if (word == "and" || word == "or")
+    {
+        if (a == 2) // 2 operators cannot appear consecutively unless second one is NOT
+            return false;
+        while (!stack.empty() && precedence(word) <= precedence(stack.back()))
+        {
+            postfix.push_back(stack.back());
+            stack.pop_back();
+        }
+        stack.push_back(word);
+        word.clear();
+        a = 2;
+    }
+    else if (word.length()) // term
+    {
+        if (a == 1) // 2 terms cannot appear consecutively
+            return false;
+        postfix.push_back(word);
+        word.clear();
+        a = 1;
+    }
+    return true;
+}
+
+// Insert last word. Last word can never be an operator
+inline bool insert_last_word(std::string& word, std::vector<std::string>& stack, std::vector<std::string>& postfix, short& a)
+{
+    if (word == "not" || word == "and" || word == "or") // operator
+        return false;
+    else if (word.length()) // term
+    {
+        if (a == 1) // 2 terms cannot appear consecutively
+            return false;
+        postfix.push_back(word);
+        word.clear();
+        a = 1;
+    }
+    return true;
+}
+
+// Reads the phrase whose opening quote is at query[i] into word as its words
+// (case folded, [a-z0-9] only) joined by single spaces, and moves i to the closing quote
+// Returns false if the quote is never closed or holds no word
+inline bool read_phrase(const std::string& query, unsigned& i, std::string& word)
+{
+    const size_t end = query.find('"', i + 1);
+    if (end == std::string::npos)
+        return false;
+    for (i++; i < end; i++)
+    {
+        const char c = query[i];
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+            word.push_back(c);
+        else if (c >= 'A' && c <= 'Z')
+            word.push_back(c | 32);
+        else if ((c == ' ' || c == '\t') && word.length() && word.back() != ' ')
+            word.push_back(' ');
+    }
+    if (word.length() && word.back() == ' ')
+        word.pop_back();
+    return word.length() > 0;
+}
+
+// Converts query to postfix; returns false if the query is incorrect
+inline bool parse_query(const std::string& query, std::vector<std::string>& postfix)
+{
+    std::vector<std::string> stack;
+    const unsigned length = query.length();
+    postfix.clear();
+
+    if (!bracket_check(query))
+        return false;
+
+    std::string word;
+    short a = 0; // 1 if prev term was term, 2 if prev term was operator, 3 in case of /k
+
+    for (unsigned i = 0; i < length; i++)
+    {
+        if ((query[i] >= 'a' && query[i] <= 'z') || (query[i] >= '0' && query[i] <= '9'))
+            word.push_back(query[i]);
+        else if (query[i] >= 'A' && query[i] <= 'Z')
+            word.push_back(query[i] | 32); // case folding
+        else if (query[i] == '"') // phrase, kept as one term whose words are separated by spaces
+        {
+            if (word.length() || !read_phrase(query, i, word))
+                return false;
+            if (i + 1 < length && query[i + 1] != ' ' && query[i + 1] != ')')
+                return false;
+        }
+        else if (query[i] == '(')
+            stack.push_back("(");
+        else if (query[i] == ')')
+        {
+            if (!insert_last_word(word, stack, postfix, a))
+                return false;
+            while (!stack.empty() && stack.back() != "(")
+            {
+                postfix.push_back(stack.back());
+                stack.pop_back();
+            }
+            stack.pop_back();
+        }
+        else if (query[i] == ' ')
+        {
+            if (!insert_word(word, stack, postfix, a))
+                return false;
+        }
+        else // Any other character
+        {
+            // That character is not part of a word so error thrown
+            if (i == 0 || query[i - 1] == ' ')
+                return false;
+            // Otherwise, character is part of word; however, it is still
+            // not pushed in word as these characters are ignored anyway
+        }
+    }
+    if (!insert_last_word(word, stack, postfix, a))
+        return false;
+    while (!stack.empty())
+    {
+        postfix.push_back(stack.back());
+        stack.pop_back();
+    }
+    remove_excess_nots(postfix);
+    return !postfix.empty();
+}
+
+// Turns a postfix query back into an infix query that parse_query() reads as the same
+// Every operator gets brackets, so precedence never matters
+inline std::string to_infix(const std::vector<std::string>& postfix)
+{
+    std::vector<std::string> stack;
+    for (const auto& word : postfix)
+    {
+        if (word == "not" && !stack.empty())
+            stack.back() = "NOT " + stack.back();
+        else if ((word == "and" || word == "or") && stack.size() >= 2)
+        {
+            std::string right = stack.back();
+            stack.pop_back();
+            stack.back() = "(" + stack.back() + (word == "and" ? " AND " : " OR ") + right + ")";
+        }
+        else if (word.find(' ') != std::string::npos) // phrase
+            stack.push_back("\"" + word + "\"");
+        else
+            stack.push_back(word);
+    }
+    return stack.empty() ? "" : stack.back();
+}
+
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include "Planner.hpp"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Cuts the doc range of a plan into disjoint intervals of about equal work,
+// so the intervals can be evaluated at the same time and their results concatenated
+namespace Partition
+{
+    using Interval = std::pair<unsigned, unsigned>; // (first doc, last doc)
+
+    // Postings under the plan's terms: roughly the work of evaluating it
+    inline unsigned long long work(const PlanPtr &node)
+    {
+        if (node->kind == PlanNode::TERM)
+            return node->posting ? observe(node->posting->doc_count) : 0;
+        unsigned long long total = 0;
+        for (const auto &part : node->parts)
+            total += observe(part.posting->doc_count);
+        for (const auto &child : node->children)
+            total += work(child);
+        return total;
+    }
+
+    // The doc IDs of every skip under the plan's terms
+    // Skips are evenly spaced in each posting, so they sample where the work lies
+    inline void sample(const PlanPtr &node, std::vector<unsigned> &docs)
+    {
+        if (node->kind == PlanNode::TERM && node->posting)
+        {
+            const size_t count = node->posting->skips.size();
+            const auto skips = node->posting->skips.data();
+            for (size_t i = 0; i < count; i++)
+                docs.push_back(skips[i]->data.ID);
+        }
+        for (const auto &child : node->children)
+            sample(child, docs);
+    }
+
+    // At most parts intervals covering first..last
+    // Without enough skips to go by the range is cut evenly
+    inline std::vector<Interval> intervals(const PlanPtr &root, const unsigned &first, const unsigned &last,
+                                           const unsigned &parts)
+    {
+        std::vector<unsigned> cuts; // first doc of every interval but the first
+        std::vector<unsigned> docs;
+        sample(root, docs);
+        if (docs.size() >= parts)
+        {
+            std::sort(docs.begin(), docs.end());
+            for (unsigned i = 1; i < parts; i++)
+                cuts.push_back(docs[docs.size() * i / parts]);
+        }
+        else
+        {
+            for (unsigned i = 1; i < parts; i++)
+                cuts.push_back(first + (unsigned long long)(last - first + 1) * i / parts);
+        }
+
+        std::vector<Interval> result;
+        unsigned from = first;
+        for (const auto &cut : cuts)
+        {
+            if (cut > from && cut <= last)
+            {
+                result.emplace_back(from, cut - 1);
+                from = cut;
+            }
+        }
+        if (from <= last)
+            result.emplace_back(from, last);
+        return result;
+    }
+}
+
+#endif
@@ -0,0 +1,216 @@
+#pragma once
+#ifndef PHRASE_HPP
+#define PHRASE_HPP
+
+#include "Cursor.hpp"
+#include "../Build/Biwords.hpp"
+#include "../Storage/PositionsFile.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A phrase query is written in quotes and reaches the planner as one word with spaces
+// ("new york"); it matches docs in which its words stand in that order, as indexed:
+// stopwords are not indexed but still take up a position, so they leave a gap
+
+// What the planner needs from the indexer to answer phrases
+struct PhraseSupport
+{
+    std::function<bool(std::string &)> keep; // stopword test and stemming, as when indexing
+    const Biwords *biwords{0};               // null if there is no biword index
+    unsigned biwords_last{0};                // docs after this one are not in the biwords
+    PositionsFile *positions{0};             // for positions that were not loaded
+};
+
+// One posting of a phrase: a word's, or a biword's (whose positions are its first word's)
+struct PhrasePart
+{
+    const Posting *posting{0};
+    unsigned offset{0}; // position in the phrase of the (first) word
+    std::string label;
+};
+
+// The words of a phrase and their offsets from its first indexed word
+// Returns an empty list if no word of the phrase is indexed
+inline std::vector<std::pair<unsigned, std::string>> phrase_words(const std::string &phrase,
+                                                                  const PhraseSupport *support)
+{
+    std::vector<std::pair<unsigned, std::string>> words;
+    unsigned offset = 0;
+    size_t from = 0;
+    while (from < phrase.size())
+    {
+        size_t to = phrase.find(' ', from);
+        if (to == std::string::npos)
+            to = phrase.size();
+        std::string word = phrase.substr(from, to - from);
+        if (!word.empty())
+        {
+            if (!support || !support->keep || support->keep(word))
+                words.emplace_back(offset, word);
+            offset++;
+        }
+        from = to + 1;
+    }
+    if (!words.empty())
+    {
+        const unsigned first = words.front().first;
+        for (auto &word : words)
+            word.first -= first;
+    }
+    return words;
+}
+
+// Docs in which every part's posting has a position at (phrase start + its offset)
+// Docs are leapfrogged as in AndCursor and only docs that have every part get their
+// positions checked, starting from the part with the fewest positions
+class PhraseCursor : public PostingCursor
+{
+public:
+    // failed is set, as by TermCursor, if postings or positions cannot be read
+    PhraseCursor(std::vector<PhrasePart> parts, const unsigned &last, PositionsFile *file,
+                 std::atomic<bool> *failed = nullptr)
+        : file(file), failed(failed)
+    {
+        std::sort(parts.begin(), parts.end(),
+                  [](const PhrasePart &a, const PhrasePart &b)
+                  { return observe(a.posting->doc_count) < observe(b.posting->doc_count); });
+        for (const auto &part : parts)
+        {
+            cursors.emplace_back(new TermCursor(part.posting, last, failed));
+            offsets.push_back(part.offset);
+        }
+        buffers.resize(cursors.size());
+        holds.resize(cursors.size());
+        find(cursors.front()->doc());
+    }
+
+    unsigned doc() const override
+    {
+        return current;
+    }
+
+    unsigned next() override
+    {
+        if (current == NO_MORE_DOCS)
+            return current;
+        return find(cursors.front()->next());
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        if (current >= target)
+            return current;
+        return find(cursors.front()->advance_to(target));
+    }
+
+    unsigned cost() const override
+    {
+        return cursors.front()->cost();
+    }
+
+    unsigned long long scanned() const override
+    {
+        unsigned long long total = checked;
+        for (const auto &cursor : cursors)
+            total += cursor->scanned();
+        return total;
+    }
+
+private:
+    std::vector<std::unique_ptr<TermCursor>> cursors; // fewest docs first
+    std::vector<unsigned> offsets;
+    std::vector<std::vector<unsigned>> buffers; // positions read from memory
+    std::vector<PositionsFile::Hold> holds;     // positions read from the file
+    PositionsFile *file{0};
+    std::atomic<bool> *failed{0};
+    unsigned current{NO_MORE_DOCS};
+    unsigned long long checked{0}; // docs whose positions were compared
+
+    // The first doc >= target that has every part, with the parts in phrase order
+    // (cursors[0] is on target when this is called)
+    unsigned find(unsigned target)
+    {
+        const size_t n = cursors.size();
+        while (target != NO_MORE_DOCS)
+        {
+            size_t agreed = 1; // how many cursors are known to sit on target
+            size_t i = 1 % n;
+            while (target != NO_MORE_DOCS && agreed < n)
+            {
+                const unsigned d = cursors[i]->advance_to(target);
+                if (d == target)
+                    agreed++;
+                else
+                {
+                    target = d;
+                    agreed = 1;
+                }
+                i = (i + 1) % n;
+            }
+            if (target == NO_MORE_DOCS || in_order())
+                break;
+            target = cursors[0]->next();
+        }
+        current = target;
+        return current;
+    }
+
+    // The positions of a part's doc; count is set to how many there are
+    const unsigned *positions_of(const size_t &i, unsigned &count)
+    {
+        const Document &doc = *cursors[i]->document();
+        count = doc.term_freq;
+        if (doc.positions_on_disk())
+        {
+            const unsigned *p = file ? file->at(doc.positions_offset, doc.term_freq, holds[i]) : nullptr;
+            if (!p)
+            {
+                count = 0;
+                if (file && failed)
+                    failed->store(true, std::memory_order_relaxed);
+            }
+            return p;
+        }
+        buffers[i].clear();
+        for (auto pos = doc.positions.begin(); pos != nullptr; pos = observe(pos->next))
+            buffers[i].push_back(pos->data);
+        count = buffers[i].size();
+        return buffers[i].data();
+    }
+
+    // Whether the words stand in phrase order somewhere in the current doc
+    bool in_order()
+    {
+        checked++;
+        const size_t n = cursors.size();
+        std::vector<const unsigned *> lists(n);
+        std::vector<unsigned> counts(n);
+        size_t rarest = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            lists[i] = positions_of(i, counts[i]);
+            if (counts[i] == 0)
+                return false;
+            if (counts[i] < counts[rarest])
+                rarest = i;
+        }
+        for (unsigned k = 0; k < counts[rarest]; k++)
+        {
+            if (lists[rarest][k] < offsets[rarest])
+                continue;
+            const unsigned start = lists[rarest][k] - offsets[rarest];
+            bool all = true;
+            for (size_t i = 0; i < n && all; i++)
+                all = i == rarest || std::binary_search(lists[i], lists[i] + counts[i], start + offsets[i]);
+            if (all)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif
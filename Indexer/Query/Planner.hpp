@@ -0,0 +1,799 @@
+#pragma once
+#ifndef PLANNER_HPP
+#define PLANNER_HPP
+
+#include "Budget.hpp"
+#include "Cursor.hpp"
+#include "Phrase.hpp"
+#include "Trace.hpp"
+#include "../Tries/Trie.hpp"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct PlanNode;
+using PlanPtr = std::shared_ptr<PlanNode>;
+
+// One operator of a query plan
+struct PlanNode
+{
+    enum Kind
+    {
+        EMPTY, // matches no doc
+        ALL,   // matches every doc
+        TERM,
+        AND,
+        OR,
+        NOT,
+        PHRASE // words in a row, written in quotes
+    };
+
+    Kind kind{EMPTY};
+    std::string term;          // TERM and PHRASE only
+    const Posting *posting{0}; // TERM only
+    std::vector<PhrasePart> parts; // PHRASE only: the postings it is matched with
+    std::vector<PlanPtr> children;
+    std::string key;           // canonical form; equal keys mean equal results
+    double estimate{0};        // estimated number of matching docs
+    const char *kernel{""};    // the physical operator picked for this node
+    bool shared{false};        // appears more than once, so it is evaluated once and reused
+    OperatorStats stats;       // filled in when the plan is run with tracing
+
+    PlanNode(const Kind &kind)
+        : kind(kind) {}
+};
+
+// Turns a postfix query into a rewritten, costed plan and then into cursors
+// Rewrites: double NOT removal, De Morgan push-down of NOT over OR,
+// flattening, duplicate and absorbed operand removal, x AND NOT x,
+// short-circuiting on empty or universal operands and common subexpressions
+// Estimates come from Posting::doc_count assuming terms are independent
+// Phrases are answered from biwords where there are any and by comparing positions otherwise
+class Planner
+{
+public:
+    // Docs are numbered min_doc..max_doc; a shard only sees its own range
+    // Without phrases, phrase words are looked up as written and positions must be in memory
+    Planner(Trie &dictionary, const unsigned &max_doc, const unsigned &min_doc = 1,
+            const PhraseSupport *phrases = nullptr)
+        : dictionary(dictionary), max_doc(max_doc), min_doc(min_doc), phrases(phrases) {}
+
+    // Returns nullptr if the query is incorrect
+    PlanPtr plan(const std::vector<std::string> &query)
+    {
+        PlanPtr parsed = parse(query);
+        return parsed ? optimize(parsed) : nullptr;
+    }
+
+    // Cursors built from now on charge every posting their leaves step over to budget
+    // and end early once it is spent (see Query/Budget.hpp); nullptr removes the budget
+    void set_budget(QueryBudget *query_budget)
+    {
+        budget = query_budget;
+    }
+
+    // Whether a cursor built by this planner found postings or positions it could not
+    // read from disk; its docs may then be missing some that match
+    bool failed() const
+    {
+        return read_failed.load(std::memory_order_relaxed);
+    }
+
+    // The query as written, before any rewrite
+    // Returns nullptr if the query is incorrect
+    static PlanPtr parse(const std::vector<std::string> &query)
+    {
+        std::vector<PlanPtr> stack;
+        for (const auto &word : query)
+        {
+            if (word == "not")
+            {
+                if (stack.empty())
+                    return nullptr;
+                stack.back() = make(PlanNode::NOT, {stack.back()});
+            }
+            else if (word == "and" || word == "or")
+            {
+                if (stack.size() < 2)
+                    return nullptr;
+                PlanPtr right = stack.back();
+                stack.pop_back();
+                PlanPtr left = stack.back();
+                stack.pop_back();
+                stack.push_back(make(word == "and" ? PlanNode::AND : PlanNode::OR, {left, right}));
+            }
+            else
+            {
+                const bool phrase = word.find(' ') != std::string::npos;
+                PlanPtr leaf = std::make_shared<PlanNode>(phrase ? PlanNode::PHRASE : PlanNode::TERM);
+                leaf->term = word;
+                stack.push_back(leaf);
+            }
+        }
+        if (stack.size() != 1)
+            return nullptr;
+        return stack.back();
+    }
+
+    // Rewrites a parsed query (which it modifies) and picks its operators
+    PlanPtr optimize(const PlanPtr &parsed)
+    {
+        look_up({parsed});
+        PlanPtr root = rewrite(parsed);
+        looked_up.clear();
+        std::map<std::string, unsigned> uses;
+        count_uses(root, uses);
+        choose(root, uses);
+        return root;
+    }
+
+    // Plans many queries to be run together with batch_cursor(); incorrect ones get nullptr
+    // A term, phrase or subexpression that more than one of them uses is marked shared,
+    // so its postings are scanned once for the whole batch and the doc IDs they give are
+    // read from memory by every query that uses them, however many there are
+    std::vector<PlanPtr> plan_batch(const std::vector<std::vector<std::string>> &queries)
+    {
+        std::vector<PlanPtr> roots;
+        for (const auto &query : queries)
+            roots.push_back(parse(query));
+        look_up(roots);
+        std::map<std::string, unsigned> uses;
+        for (auto &root : roots)
+        {
+            if (root)
+            {
+                root = rewrite(root);
+                count_uses(root, uses, true);
+            }
+        }
+        looked_up.clear();
+        for (const auto &root : roots)
+        {
+            if (root)
+                choose(root, uses);
+        }
+        batch_cache.clear();
+        return roots;
+    }
+
+    // Builds the cursors for a plan from plan_batch(); what it shares with the
+    // other plans of the batch is evaluated by the first of them to be built
+    // and kept until the next plan_batch()
+    CursorPtr batch_cursor(const PlanPtr &node)
+    {
+        tracing = false;
+        reuse = true;
+        window_first = 1;
+        window_last = NO_MORE_DOCS - 1;
+        return lower(node, batch_cache);
+    }
+
+    // Builds the cursors for a plan; shared subplans are evaluated once
+    // With trace every operator records what it does into its stats,
+    // which are complete once the returned cursor is destroyed
+    CursorPtr cursor(const PlanPtr &node, const bool &trace = false)
+    {
+        Cache cache;
+        tracing = trace;
+        reuse = true;
+        window_first = 1;
+        window_last = NO_MORE_DOCS - 1;
+        return lower(node, cache);
+    }
+
+    // The same plan positioned on its first doc >= first, doing no more work than that:
+    // shared subplans get cursors of their own instead of being materialized up front,
+    // so how soon the first docs come back does not depend on how many docs match
+    CursorPtr lazy_cursor(const PlanPtr &node, const unsigned &first)
+    {
+        Cache cache;
+        tracing = false;
+        reuse = false;
+        CursorPtr root = lower(node, cache);
+        root->advance_to(first);
+        return root;
+    }
+
+    // The same plan over the docs first..last only, so disjoint ranges can be
+    // evaluated at the same time; shared subplans are materialized over the range alone
+    // One Planner must not build cursors on two threads at once
+    CursorPtr cursor_in(const PlanPtr &node, const unsigned &first, const unsigned &last)
+    {
+        Cache cache;
+        tracing = false;
+        reuse = true;
+        window_first = first;
+        window_last = last;
+        return CursorPtr(new RangeCursor(lower(node, cache), first, last));
+    }
+
+    // One line per operator, indented by depth
+    // Operators that ran with tracing also show what they did
+    static std::string explain(const PlanPtr &node)
+    {
+        std::ostringstream out;
+        explainUtil(node, 0, out);
+        return out.str();
+    }
+
+    // The same as explain() as a single line of JSON
+    static std::string explain_json(const PlanPtr &node)
+    {
+        std::ostringstream out;
+        jsonUtil(node, out);
+        return out.str();
+    }
+
+    static const char *name(const PlanNode::Kind &kind)
+    {
+        switch (kind)
+        {
+        case PlanNode::EMPTY: return "EMPTY";
+        case PlanNode::ALL: return "ALL";
+        case PlanNode::TERM: return "TERM";
+        case PlanNode::AND: return "AND";
+        case PlanNode::OR: return "OR";
+        case PlanNode::PHRASE: return "PHRASE";
+        default: return "NOT";
+        }
+    }
+
+private:
+    using Cache = std::map<std::string, std::shared_ptr<const std::vector<unsigned>>>;
+
+    Trie &dictionary;
+    unsigned max_doc;
+    unsigned min_doc;
+    const PhraseSupport *phrases;
+    bool tracing{false};
+    bool reuse{true};                       // materialize shared subplans
+    unsigned window_first{1};               // the range cursor() or cursor_in() is building for
+    unsigned window_last{NO_MORE_DOCS - 1};
+    const static size_t heap_union_threshold = 8; // from this many children a heap beats a linear scan
+    const static size_t batch_lookup_min = 4;     // from this many terms they are looked up together
+    std::map<std::string, HashEntry *> looked_up; // by look_up(), for rewrite()
+    Cache batch_cache;                            // shared results of the plans of plan_batch()
+    QueryBudget *budget{0};                       // charged by the leaves of every cursor built
+    std::atomic<bool> read_failed{false};         // set by leaves that cannot read their postings
+
+    static PlanPtr make(const PlanNode::Kind &kind, std::vector<PlanPtr> children)
+    {
+        PlanPtr node = std::make_shared<PlanNode>(kind);
+        node->children = std::move(children);
+        return node;
+    }
+
+    static bool negates(const PlanPtr &a, const PlanPtr &b)
+    {
+        return (a->kind == PlanNode::NOT && a->children[0]->key == b->key)
+            || (b->kind == PlanNode::NOT && b->children[0]->key == a->key);
+    }
+
+    // The keys of the operands of a node (the node itself if it is not of kind)
+    static std::vector<std::string> operands(const PlanPtr &node, const PlanNode::Kind &kind)
+    {
+        std::vector<std::string> keys;
+        if (node->kind == kind)
+        {
+            for (const auto &child : node->children)
+                keys.push_back(child->key);
+        }
+        else
+            keys.push_back(node->key);
+        std::sort(keys.begin(), keys.end());
+        return keys;
+    }
+
+    // Collects the words of a query's terms and phrases
+    void leaf_words(const PlanPtr &node, std::vector<std::string> &words) const
+    {
+        if (node->kind == PlanNode::TERM)
+            words.push_back(node->term);
+        else if (node->kind == PlanNode::PHRASE)
+        {
+            for (auto &word : phrase_words(node->term, phrases))
+                words.push_back(word.second);
+        }
+        for (const auto &child : node->children)
+            leaf_words(child, words);
+    }
+
+    // Looks up every word of large enough queries at once, so that the trie walks
+    // overlap (see Trie::search_many) instead of taking turns as rewrite() meets them
+    void look_up(const std::vector<PlanPtr> &parsed)
+    {
+        std::vector<std::string> words;
+        for (const auto &root : parsed)
+        {
+            if (root)
+                leaf_words(root, words);
+        }
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+        if (words.size() < batch_lookup_min)
+            return;
+        const std::vector<HashEntry *> found = dictionary.search_many(words);
+        for (size_t i = 0; i < words.size(); i++)
+            looked_up.emplace(words[i], found[i]);
+    }
+
+    HashEntry *lookup(const std::string &word)
+    {
+        auto found = looked_up.find(word);
+        return found != looked_up.end() ? found->second : dictionary.search(word);
+    }
+
+    // Rewrites bottom-up and fills in keys and estimates
+    PlanPtr rewrite(const PlanPtr &node)
+    {
+        const double n = max_doc + 1 - min_doc;
+        switch (node->kind)
+        {
+        case PlanNode::TERM:
+        {
+            HashEntry *h = lookup(node->term);
+            const Posting *posting = h ? observe(h->posting) : nullptr;
+            const unsigned doc_count = posting ? observe(posting->doc_count) : 0;
+            if (doc_count == 0)
+                return finish(make(PlanNode::EMPTY, {}));
+            node->posting = posting;
+            node->key = node->term;
+            node->estimate = doc_count;
+            return node;
+        }
+        case PlanNode::PHRASE:
+            return rewrite_phrase(node);
+        case PlanNode::NOT:
+        {
+            PlanPtr child = rewrite(node->children[0]);
+            if (child->kind == PlanNode::EMPTY)
+                return finish(make(PlanNode::ALL, {}));
+            if (child->kind == PlanNode::ALL)
+                return finish(make(PlanNode::EMPTY, {}));
+            if (child->kind == PlanNode::NOT)
+                return child->children[0];
+            if (child->kind == PlanNode::OR)
+            {
+                // De Morgan: NOT (a OR b) = NOT a AND NOT b, which becomes a
+                // difference as soon as it meets a positive operand
+                std::vector<PlanPtr> negated;
+                for (const auto &grandchild : child->children)
+                    negated.push_back(make(PlanNode::NOT, {grandchild}));
+                return rewrite(make(PlanNode::AND, negated));
+            }
+            node->children[0] = child;
+            node->key = "not(" + child->key + ")";
+            node->estimate = n - child->estimate;
+            return node;
+        }
+        case PlanNode::AND:
+        case PlanNode::OR:
+        {
+            const bool is_and = node->kind == PlanNode::AND;
+            const PlanNode::Kind absorbing = is_and ? PlanNode::EMPTY : PlanNode::ALL;
+            const PlanNode::Kind neutral = is_and ? PlanNode::ALL : PlanNode::EMPTY;
+
+            std::vector<PlanPtr> children;
+            for (const auto &child : node->children)
+            {
+                PlanPtr c = rewrite(child);
+                if (c->kind == absorbing)
+                    return c;
+                if (c->kind == neutral)
+                    continue;
+                if (c->kind == node->kind) // flatten
+                    children.insert(children.end(), c->children.begin(), c->children.end());
+                else
+                    children.push_back(c);
+            }
+
+            // Duplicates, and x AND NOT x / x OR NOT x
+            std::sort(children.begin(), children.end(),
+                      [](const PlanPtr &a, const PlanPtr &b) { return a->key < b->key; });
+            children.erase(std::unique(children.begin(), children.end(),
+                                       [](const PlanPtr &a, const PlanPtr &b) { return a->key == b->key; }),
+                           children.end());
+            for (size_t i = 0; i < children.size(); i++)
+            {
+                for (size_t j = i + 1; j < children.size(); j++)
+                {
+                    if (negates(children[i], children[j]))
+                        return finish(make(absorbing, {}));
+                }
+            }
+
+            // (a OR b) AND NOT a AND NOT b, which is what De Morgan leaves of (a OR b) AND NOT (a OR b)
+            if (is_and)
+            {
+                std::vector<std::string> negated;
+                for (const auto &child : children)
+                {
+                    if (child->kind == PlanNode::NOT)
+                        negated.push_back(child->children[0]->key);
+                }
+                std::sort(negated.begin(), negated.end());
+                for (const auto &child : children)
+                {
+                    if (child->kind != PlanNode::OR)
+                        continue;
+                    std::vector<std::string> alternatives = operands(child, PlanNode::OR);
+                    if (std::includes(negated.begin(), negated.end(), alternatives.begin(), alternatives.end()))
+                        return finish(make(PlanNode::EMPTY, {}));
+                }
+            }
+
+            // Absorption: x AND (x OR y) = x and x OR (x AND y) = x
+            const PlanNode::Kind inner = is_and ? PlanNode::OR : PlanNode::AND;
+            std::vector<bool> absorbed(children.size(), false);
+            for (size_t i = 0; i < children.size(); i++)
+            {
+                if (children[i]->kind != inner)
+                    continue;
+                std::vector<std::string> outer = operands(children[i], inner);
+                for (size_t j = 0; j < children.size() && !absorbed[i]; j++)
+                {
+                    if (i == j || absorbed[j])
+                        continue;
+                    std::vector<std::string> smaller = operands(children[j], inner);
+                    if (std::includes(outer.begin(), outer.end(), smaller.begin(), smaller.end()))
+                        absorbed[i] = true;
+                }
+            }
+            std::vector<PlanPtr> kept;
+            for (size_t i = 0; i < children.size(); i++)
+            {
+                if (!absorbed[i])
+                    kept.push_back(children[i]);
+            }
+
+            if (kept.empty())
+                return finish(make(neutral, {}));
+            if (kept.size() == 1)
+                return kept[0];
+
+            node->children = kept;
+            node->key = is_and ? "and(" : "or(";
+            double fraction = 1;
+            for (size_t i = 0; i < kept.size(); i++)
+            {
+                node->key += (i ? "," : "") + kept[i]->key;
+                fraction *= is_and ? kept[i]->estimate / n : 1 - kept[i]->estimate / n;
+            }
+            node->key += ")";
+            node->estimate = is_and ? n * fraction : n * (1 - fraction);
+            return node;
+        }
+        default:
+            return finish(node);
+        }
+    }
+
+    // A phrase of one indexed word is that word; otherwise every adjacent pair of words
+    // that has a biword is matched through it, and the words no biword covers alone
+    PlanPtr rewrite_phrase(const PlanPtr &node)
+    {
+        auto words = phrase_words(node->term, phrases);
+        if (words.empty())
+            return finish(make(PlanNode::EMPTY, {}));
+        if (words.size() == 1)
+        {
+            PlanPtr term = make(PlanNode::TERM, {});
+            term->term = words[0].second;
+            return rewrite(term);
+        }
+
+        std::vector<const Posting *> postings;
+        node->key = "phrase(";
+        for (const auto &word : words)
+        {
+            HashEntry *h = lookup(word.second);
+            const Posting *posting = h ? observe(h->posting) : nullptr;
+            if (!posting || observe(posting->doc_count) == 0)
+                return finish(make(PlanNode::EMPTY, {}));
+            postings.push_back(posting);
+            node->key += (postings.size() > 1 ? "," : "") + word.second + "@" + std::to_string(word.first);
+        }
+        node->key += ")";
+
+        node->parts.clear();
+        std::vector<bool> covered(words.size(), false);
+        // Biwords only help if they hold every doc this plan may return
+        const Biwords *biwords = phrases && max_doc <= phrases->biwords_last ? phrases->biwords : nullptr;
+        for (size_t i = 0; biwords && i + 1 < words.size(); i++)
+        {
+            if (words[i + 1].first != words[i].first + 1)
+                continue;
+            const Posting *pair = biwords->search(words[i].second, words[i + 1].second);
+            if (!pair)
+                continue;
+            node->parts.push_back(PhrasePart{pair, words[i].first, words[i].second + " " + words[i + 1].second});
+            covered[i] = covered[i + 1] = true;
+        }
+        for (size_t i = 0; i < words.size(); i++)
+        {
+            if (!covered[i])
+                node->parts.push_back(PhrasePart{postings[i], words[i].first, words[i].second});
+        }
+
+        node->estimate = max_doc + 1 - min_doc;
+        for (const auto &part : node->parts)
+            node->estimate = std::min<double>(node->estimate, observe(part.posting->doc_count));
+        return node;
+    }
+
+    // Keys and estimates of EMPTY and ALL
+    PlanPtr finish(const PlanPtr &node)
+    {
+        node->key = name(node->kind);
+        node->estimate = node->kind == PlanNode::ALL ? max_doc + 1 - min_doc : 0;
+        return node;
+    }
+
+    // With leaves, terms and phrases are counted too: within one query a term is
+    // cheaper to scan twice than to copy, but not once many queries scan it
+    static void count_uses(const PlanPtr &node, std::map<std::string, unsigned> &uses, const bool &leaves = false)
+    {
+        if (node->kind == PlanNode::TERM || node->children.empty())
+        {
+            if (leaves && (node->kind == PlanNode::TERM || node->kind == PlanNode::PHRASE))
+                uses[node->key]++;
+            return;
+        }
+        if (uses[node->key]++) // children of a repeated node are only evaluated once
+            return;
+        for (const auto &child : node->children)
+            count_uses(child, uses, leaves);
+    }
+
+    // Picks a physical operator for every node
+    void choose(const PlanPtr &node, const std::map<std::string, unsigned> &uses)
+    {
+        auto found = uses.find(node->key);
+        node->shared = found != uses.end() && found->second > 1;
+
+        switch (node->kind)
+        {
+        case PlanNode::EMPTY: node->kernel = "empty"; break;
+        case PlanNode::ALL: node->kernel = "all docs"; break;
+        case PlanNode::TERM: node->kernel = "posting scan"; break;
+        case PlanNode::NOT: node->kernel = "complement"; break;
+        case PlanNode::PHRASE:
+        {
+            bool biword = false; // a biword's label is its two words
+            for (const auto &part : node->parts)
+                biword |= part.label.find(' ') != std::string::npos;
+            if (node->parts.size() == 1)
+                node->kernel = "biword scan";
+            else
+                node->kernel = biword ? "biword positional merge" : "positional merge";
+            break;
+        }
+        case PlanNode::OR:
+            node->kernel = node->children.size() >= heap_union_threshold ? "heap union" : "linear union";
+            break;
+        case PlanNode::AND:
+        {
+            size_t negative = 0;
+            for (const auto &child : node->children)
+                negative += child->kind == PlanNode::NOT;
+            if (negative == node->children.size())
+                node->kernel = "complement of union";
+            else if (negative)
+                node->kernel = "leapfrog intersection minus union";
+            else
+                node->kernel = "leapfrog intersection";
+            break;
+        }
+        }
+        // Cheapest operands first, which is also the order they are probed in
+        std::sort(node->children.begin(), node->children.end(),
+                  [](const PlanPtr &a, const PlanPtr &b) { return a->estimate < b->estimate; });
+        for (const auto &child : node->children)
+            choose(child, uses);
+    }
+
+    CursorPtr lower(const PlanPtr &node, Cache &cache)
+    {
+        if (node->shared && reuse)
+        {
+            auto &docs = cache[node->key];
+            if (!docs)
+            {
+                auto result = std::make_shared<std::vector<unsigned>>();
+                CursorPtr c = traced(node, cache);
+                for (unsigned d = c->advance_to(window_first); d <= window_last; d = c->next())
+                    result->push_back(d);
+                docs = result;
+            }
+            return budgeted(CursorPtr(new ListCursor(docs)));
+        }
+        return traced(node, cache);
+    }
+
+    // A leaf cursor, wrapped so that it stops once the budget is spent
+    CursorPtr budgeted(CursorPtr leaf)
+    {
+        if (!budget)
+            return leaf;
+        return CursorPtr(new BudgetCursor(std::move(leaf), *budget));
+    }
+
+    // build(), wrapped in a TracingCursor when tracing
+    // Construction is timed too since cursors position themselves when built
+    CursorPtr traced(const PlanPtr &node, Cache &cache)
+    {
+        if (!tracing)
+            return build(node, cache);
+        auto start = std::chrono::steady_clock::now();
+        CursorPtr c(new TracingCursor(build(node, cache), node->stats));
+        node->stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now() - start).count();
+        return c;
+    }
+
+    CursorPtr build(const PlanPtr &node, Cache &cache)
+    {
+        switch (node->kind)
+        {
+        case PlanNode::EMPTY:
+            return CursorPtr(new TermCursor(nullptr));
+        case PlanNode::ALL:
+            return CursorPtr(new NotCursor(CursorPtr(new TermCursor(nullptr)), max_doc, min_doc));
+        case PlanNode::TERM:
+            return budgeted(CursorPtr(new TermCursor(node->posting, max_doc, &read_failed)));
+        case PlanNode::NOT:
+            return CursorPtr(new NotCursor(lower(node->children[0], cache), max_doc, min_doc));
+        case PlanNode::OR:
+            return union_of(node->children, cache);
+        case PlanNode::PHRASE:
+            // A biword that is the whole phrase needs no positions
+            if (node->parts.size() == 1)
+                return budgeted(CursorPtr(new TermCursor(node->parts[0].posting, max_doc, &read_failed)));
+            return budgeted(CursorPtr(new PhraseCursor(node->parts, max_doc, phrases ? phrases->positions : nullptr,
+                                                       &read_failed)));
+        default:
+        {
+            std::vector<PlanPtr> positive, negative;
+            for (const auto &child : node->children)
+            {
+                if (child->kind == PlanNode::NOT)
+                    negative.push_back(child->children[0]);
+                else
+                    positive.push_back(child);
+            }
+            if (positive.empty())
+                return CursorPtr(new NotCursor(union_of(negative, cache), max_doc, min_doc));
+
+            CursorPtr include;
+            if (positive.size() == 1)
+                include = lower(positive[0], cache);
+            else
+            {
+                std::vector<CursorPtr> children;
+                for (const auto &child : positive)
+                    children.push_back(lower(child, cache));
+                include = CursorPtr(new AndCursor(std::move(children)));
+            }
+            if (negative.empty())
+                return include;
+            return CursorPtr(new AndNotCursor(std::move(include), union_of(negative, cache)));
+        }
+        }
+    }
+
+    CursorPtr union_of(const std::vector<PlanPtr> &nodes,
+                       Cache &cache)
+    {
+        if (nodes.size() == 1)
+            return lower(nodes[0], cache);
+        std::vector<CursorPtr> children;
+        for (const auto &child : nodes)
+            children.push_back(lower(child, cache));
+        if (children.size() >= heap_union_threshold)
+            return CursorPtr(new HeapOrCursor(std::move(children)));
+        return CursorPtr(new OrCursor(std::move(children)));
+    }
+
+    // Docs that flowed into an operator: its postings for a term, its children's output otherwise
+    static unsigned long long input(const PlanPtr &node)
+    {
+        if (node->kind == PlanNode::TERM)
+            return node->posting ? node->posting->doc_count : 0;
+        unsigned long long total = 0;
+        for (const auto &part : node->parts)
+            total += part.posting->doc_count;
+        for (const auto &child : node->children)
+            total += child->stats.ran ? child->stats.output : input(child); // a folded NOT passes its input on
+        return total;
+    }
+
+    // Time spent in the operator itself
+    static unsigned long long self_nanos(const PlanPtr &node)
+    {
+        unsigned long long children = 0;
+        for (const auto &child : node->children)
+            children += child->stats.nanos;
+        return node->stats.nanos > children ? node->stats.nanos - children : 0;
+    }
+
+    static void explainUtil(const PlanPtr &node, const unsigned &depth, std::ostringstream &out)
+    {
+        out << std::string(2 * depth, ' ') << name(node->kind);
+        if (node->kind == PlanNode::TERM)
+        {
+            out << " " << node->term;
+            if (node->posting)
+                out << " (doc_count " << node->posting->doc_count << ")";
+        }
+        if (node->kind == PlanNode::PHRASE)
+        {
+            out << " \"" << node->term << "\"";
+            for (size_t i = 0; i < node->parts.size(); i++)
+                out << (i ? ", " : " via ") << node->parts[i].label << " (doc_count "
+                    << node->parts[i].posting->doc_count << ")";
+        }
+        if (!node->key.empty()) // parsed but not yet planned nodes have no key
+            out << " [" << node->kernel << "] est " << node->estimate;
+        if (node->shared)
+            out << (node->stats.ran || node->key.empty() ? " shared" : " shared, reused");
+        if (node->stats.ran)
+            out << " | in " << input(node)
+                << " out " << node->stats.output
+                << " calls " << node->stats.calls
+                << " scanned " << node->stats.scanned
+                << " time " << node->stats.nanos << " ns"
+                << " (self " << self_nanos(node) << " ns)";
+        out << "\n";
+        for (const auto &child : node->children)
+            explainUtil(child, depth + 1, out);
+    }
+
+    static void jsonUtil(const PlanPtr &node, std::ostringstream &out)
+    {
+        out << "{\"op\":\"" << name(node->kind) << "\"";
+        if (node->kind == PlanNode::TERM)
+        {
+            out << ",\"term\":\"" << node->term << "\""; // terms are only [a-z0-9]
+            if (node->posting)
+                out << ",\"doc_count\":" << node->posting->doc_count;
+        }
+        if (node->kind == PlanNode::PHRASE)
+        {
+            out << ",\"phrase\":\"" << node->term << "\"";
+            for (size_t i = 0; i < node->parts.size(); i++) // a parsed phrase has no parts yet
+                out << (i ? "," : ",\"parts\":[") << "{\"posting\":\"" << node->parts[i].label
+                    << "\",\"doc_count\":" << node->parts[i].posting->doc_count << "}";
+            if (!node->parts.empty())
+                out << "]";
+        }
+        if (!node->key.empty())
+            out << ",\"kernel\":\"" << node->kernel << "\",\"estimate\":" << node->estimate
+                << ",\"shared\":" << (node->shared ? "true" : "false");
+        if (node->stats.ran)
+            out << ",\"input\":" << input(node)
+                << ",\"output\":" << node->stats.output
+                << ",\"calls\":" << node->stats.calls
+                << ",\"scanned\":" << node->stats.scanned
+                << ",\"ns\":" << node->stats.nanos
+                << ",\"self_ns\":" << self_nanos(node);
+        if (!node->children.empty())
+        {
+            out << ",\"children\":[";
+            for (size_t i = 0; i < node->children.size(); i++)
+            {
+                if (i)
+                    out << ",";
+                jsonUtil(node->children[i], out);
+            }
+            out << "]";
+        }
+        out << "}";
+    }
+};
+
+#endif
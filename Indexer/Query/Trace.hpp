@@ -0,0 +1,90 @@
+#pragma once
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "Cursor.hpp"
+#include <chrono>
+
+// What one operator did while a query ran
+struct OperatorStats
+{
+    unsigned long long calls{0};   // next() and advance_to() calls
+    unsigned long long output{0};  // docs the operator produced
+    unsigned long long scanned{0}; // posting entries stepped over by the operator itself
+    unsigned long long nanos{0};   // time spent inside the operator, children included
+    bool ran{false};               // false if the operator was folded into its parent
+};
+
+// Wraps a cursor and records its calls, output and time into stats
+// Only used for EXPLAIN, so the clock reads do not slow down normal queries
+class TracingCursor : public PostingCursor
+{
+public:
+    TracingCursor(CursorPtr inner, OperatorStats &stats)
+        : inner(std::move(inner)), stats(stats)
+    {
+        stats.ran = true;
+        count(this->inner->doc());
+    }
+
+    ~TracingCursor()
+    {
+        stats.scanned += inner->scanned();
+    }
+
+    unsigned doc() const override
+    {
+        return inner->doc();
+    }
+
+    unsigned next() override
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned d = inner->next();
+        stop(start);
+        return count(d);
+    }
+
+    unsigned advance_to(const unsigned &target) override
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned d = inner->advance_to(target);
+        stop(start);
+        return count(d);
+    }
+
+    unsigned cost() const override
+    {
+        return inner->cost();
+    }
+
+    unsigned long long scanned() const override
+    {
+        return inner->scanned();
+    }
+
+private:
+    CursorPtr inner;
+    OperatorStats &stats;
+    unsigned last{NO_MORE_DOCS};
+
+    void stop(const std::chrono::steady_clock::time_point &start)
+    {
+        stats.calls++;
+        stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Counts every doc the cursor lands on once, however it got there
+    unsigned count(const unsigned &d)
+    {
+        if (d != NO_MORE_DOCS && d != last)
+        {
+            stats.output++;
+            last = d;
+        }
+        return d;
+    }
+};
+
+#endif
@@ -0,0 +1,135 @@
+#pragma once
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+// A log-linear latency histogram in the style of HdrHistogram
+// Values (e.g. nanoseconds) are kept with 7 significant bits (<1% error)
+// over the whole 64 bit range in a few thousand counters
+class Histogram
+{
+public:
+    Histogram()
+        : counts(buckets, 0) {}
+
+    void record(const unsigned long long &value, const unsigned long long &count = 1)
+    {
+        counts[index(value)] += count;
+        total += count;
+        sum += (long double)value * count;
+        lowest = std::min(lowest, value);
+        highest = std::max(highest, value);
+    }
+
+    // Records value and, if it is longer than the interval at which requests
+    // were supposed to be issued, the requests that a stalled client never sent
+    // (value - interval, value - 2 * interval, ...) to undo coordinated omission
+    void record_corrected(const unsigned long long &value, const unsigned long long &expected_interval,
+                          const unsigned long long &count = 1)
+    {
+        record(value, count);
+        if (expected_interval == 0)
+            return;
+        for (unsigned long long missed = value; missed > expected_interval;)
+        {
+            missed -= expected_interval;
+            if (missed < expected_interval)
+                break;
+            record(missed, count);
+        }
+    }
+
+    // A copy with coordinated omission corrected after the fact
+    Histogram corrected(const unsigned long long &expected_interval) const
+    {
+        Histogram result;
+        for (unsigned i = 0; i < buckets; i++)
+        {
+            if (counts[i])
+                result.record_corrected(value_at(i), expected_interval, counts[i]);
+        }
+        return result;
+    }
+
+    void merge(const Histogram &other)
+    {
+        for (unsigned i = 0; i < buckets; i++)
+            counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        lowest = std::min(lowest, other.lowest);
+        highest = std::max(highest, other.highest);
+    }
+
+    // The value below which percent% of the recorded values fall
+    unsigned long long percentile(const double &percent) const
+    {
+        if (total == 0)
+            return 0;
+        unsigned long long wanted = std::max(1ULL, (unsigned long long)(percent / 100 * total + 0.5));
+        unsigned long long seen = 0;
+        for (unsigned i = 0; i < buckets; i++)
+        {
+            seen += counts[i];
+            if (seen >= wanted)
+                return std::min(value_at(i), highest);
+        }
+        return highest;
+    }
+
+    unsigned long long count() const { return total; }
+    unsigned long long min() const { return total ? lowest : 0; }
+    unsigned long long max() const { return highest; }
+    double mean() const { return total ? double(sum / total) : 0; }
+
+    // One line of percentiles; values are divided by scale (e.g. 1000 for ns -> us)
+    void print(std::ostream &out, const char *label, const double &scale = 1000, const char *unit = "us") const
+    {
+        out << std::fixed << std::setprecision(1)
+            << label << " (" << unit << "): n " << total
+            << "  min " << min() / scale
+            << "  mean " << mean() / scale
+            << "  p50 " << percentile(50) / scale
+            << "  p90 " << percentile(90) / scale
+            << "  p99 " << percentile(99) / scale
+            << "  p99.9 " << percentile(99.9) / scale
+            << "  p99.99 " << percentile(99.99) / scale
+            << "  max " << max() / scale << "\n";
+        out.unsetf(std::ios::floatfield);
+    }
+
+private:
+    const static unsigned sub_buckets = 128; // values below this are exact
+    const static unsigned half = sub_buckets / 2;
+    const static unsigned buckets = sub_buckets + 57 * half;
+
+    std::vector<unsigned long long> counts;
+    unsigned long long total{0};
+    long double sum{0};
+    unsigned long long lowest{~0ULL};
+    unsigned long long highest{0};
+
+    static unsigned index(const unsigned long long &value)
+    {
+        if (value < sub_buckets)
+            return value;
+        const unsigned shift = 63 - __builtin_clzll(value) - 6; // keep the top 7 bits
+        return sub_buckets + (shift - 1) * half + ((value >> shift) - half);
+    }
+
+    // The middle of the values that share bucket i
+    static unsigned long long value_at(const unsigned &i)
+    {
+        if (i < sub_buckets)
+            return i;
+        const unsigned shift = (i - sub_buckets) / half + 1;
+        const unsigned long long top = (i - sub_buckets) % half + half;
+        return (top << shift) + (1ULL << (shift - 1));
+    }
+};
+
+#endif
@@ -0,0 +1,175 @@
+#pragma once
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include "../Tries/Trie.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// A hard limit on the bytes an index may take while it is loaded
+// Loaders charge every node they allocate and stop as soon as a charge fails
+class MemoryBudget
+{
+public:
+    enum Policy
+    {
+        FAIL,          // loading fails
+        SKIP_POSITIONS // loading is retried without positions
+    };
+
+    MemoryBudget(const unsigned long long &limit = 0, const Policy &policy = FAIL)
+        : limit(limit), policy(policy) {}
+
+    MemoryBudget(const MemoryBudget &other)
+        : limit(other.limit), policy(other.policy), used(other.used.load()) {}
+
+    MemoryBudget &operator=(const MemoryBudget &other)
+    {
+        limit = other.limit;
+        policy = other.policy;
+        used = other.used.load();
+        return *this;
+    }
+
+    // Returns false if the bytes do not fit; a limit of 0 means no limit
+    // Safe to call from several loader threads at once
+    bool charge(const unsigned long long &bytes)
+    {
+        unsigned long long total = used.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        return limit == 0 || total <= limit;
+    }
+
+    void reset() { used = 0; }
+    bool limited() const { return limit != 0; }
+    unsigned long long charged() const { return used.load(); }
+
+    unsigned long long limit{0};
+    Policy policy{FAIL};
+
+private:
+    std::atomic<unsigned long long> used{0};
+};
+
+// Bytes and object counts of everything a loaded index keeps in memory
+// Sizes are sizeof() of the objects; allocator overhead is not included
+struct MemoryReport
+{
+    struct Item
+    {
+        std::string name;
+        unsigned long long count{0};
+        unsigned long long bytes{0};
+    };
+
+    std::vector<Item> items;
+    std::vector<std::pair<unsigned long long, std::string>> largest_terms; // (bytes, term)
+    unsigned long long terms{0};
+    unsigned long long postings{0};  // (term, doc) pairs
+    unsigned long long positions{0}; // positions held in memory
+    unsigned long long posting_bytes{0};
+    unsigned long long position_bytes{0};
+
+    unsigned long long total() const
+    {
+        unsigned long long sum = 0;
+        for (const Item &item : items)
+            sum += item.bytes;
+        return sum;
+    }
+
+    // Walks the whole trie; top is how many of the largest terms to keep
+    static MemoryReport of(Trie &dictionary, const unsigned &top = 10)
+    {
+        MemoryReport report;
+
+        std::vector<Item> levels;
+        dictionary.for_each_table([&](HashTable *, const unsigned &depth)
+        {
+            if (depth >= levels.size())
+                levels.resize(depth + 1);
+            levels[depth].count++;
+            levels[depth].bytes += sizeof(HashTable);
+        });
+        for (unsigned i = 0; i < levels.size(); i++)
+        {
+            levels[i].name = "HashTable level " + std::to_string(i);
+            report.items.push_back(levels[i]);
+        }
+
+        Item posting_item{"Posting", 0, 0};
+        Item document_item{"Document nodes", 0, 0};
+        Item position_item{"Position nodes", 0, 0};
+        Item skip_item{"Skip pointers", 0, 0};
+
+        dictionary.for_each([&](const std::string &term, Posting *posting)
+        {
+            unsigned long long bytes = sizeof(Posting);
+            posting_item.count++;
+            skip_item.count += posting->skips.size();
+            bytes += posting->skips.bytes();
+            skip_item.bytes += posting->skips.bytes();
+            for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next)
+            {
+                document_item.count++;
+                bytes += sizeof(Node<Document>);
+                for (auto pos = doc->data.positions.begin(); pos != nullptr; pos = pos->next)
+                {
+                    position_item.count++;
+                    bytes += sizeof(Node<unsigned>);
+                }
+            }
+            report.largest_terms.emplace_back(bytes, term);
+        });
+        posting_item.bytes = posting_item.count * sizeof(Posting);
+        document_item.bytes = document_item.count * sizeof(Node<Document>);
+        position_item.bytes = position_item.count * sizeof(Node<unsigned>);
+        report.items.push_back(posting_item);
+        report.items.push_back(document_item);
+        report.items.push_back(position_item);
+        report.items.push_back(skip_item);
+
+        report.terms = posting_item.count;
+        report.postings = document_item.count;
+        report.positions = position_item.count;
+        report.posting_bytes = posting_item.bytes + document_item.bytes + skip_item.bytes;
+        report.position_bytes = position_item.bytes;
+
+        const size_t keep = std::min<size_t>(top, report.largest_terms.size());
+        std::partial_sort(report.largest_terms.begin(), report.largest_terms.begin() + keep,
+                          report.largest_terms.end(),
+                          std::greater<std::pair<unsigned long long, std::string>>());
+        report.largest_terms.resize(keep);
+        return report;
+    }
+
+    void add(const std::string &name, const unsigned long long &count, const unsigned long long &bytes)
+    {
+        items.push_back(Item{name, count, bytes});
+    }
+
+    void print(std::ostream &out) const
+    {
+        out << std::left << std::setw(24) << "Structure"
+            << std::right << std::setw(12) << "Objects"
+            << std::setw(14) << "Bytes" << "\n";
+        for (const Item &item : items)
+            out << std::left << std::setw(24) << item.name
+                << std::right << std::setw(12) << item.count
+                << std::setw(14) << item.bytes << "\n";
+        out << "Total bytes: " << total() << "\n"
+            << "Terms: " << terms << ", postings: " << postings << ", positions: " << positions << "\n"
+            << "Bytes per posting: " << (postings ? double(posting_bytes) / postings : 0) << "\n"
+            << "Bytes per position: " << (positions ? double(position_bytes) / positions : 0) << "\n"
+            << "Largest terms:\n";
+        for (const auto &term : largest_terms)
+            out << "  " << term.second << " " << term.first << " bytes\n";
+    }
+};
+
+#endif
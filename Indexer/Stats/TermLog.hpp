@@ -0,0 +1,111 @@
+#pragma once
+#ifndef TERM_LOG_HPP
+#define TERM_LOG_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// How often each term was asked for by the queries an index answered
+// Kept next to the index (write() and read()), so that after a restart or a reload
+// the blocks of the terms asked for most can be read in before the first query
+// (see Indexer::warm_up); record() may be called from several threads at once
+class TermLog
+{
+public:
+    // What Indexer::warm_up() read in
+    struct Warmed
+    {
+        unsigned terms{0};
+        unsigned long long bytes{0};
+        unsigned long long ms{0};
+
+        void print(std::ostream &out) const
+        {
+            out << "Warmed up " << terms << " terms, " << bytes << " bytes in " << ms << " ms\n";
+        }
+    };
+
+    // Counts the words of a query in postfix form; a phrase counts as its words
+    void record(const std::vector<std::string> &query)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (const auto &word : query)
+        {
+            if (word == "and" || word == "or" || word == "not")
+                continue;
+            for (size_t from = 0, to; from < word.size(); from = to + 1)
+            {
+                to = std::min(word.find(' ', from), word.size());
+                if (to > from)
+                    counts[word.substr(from, to - from)]++;
+            }
+        }
+    }
+
+    // The terms asked for most, most first
+    std::vector<std::pair<std::string, unsigned long long>> top(const size_t &limit) const
+    {
+        std::vector<std::pair<std::string, unsigned long long>> terms;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            terms.assign(counts.begin(), counts.end());
+        }
+        const size_t keep = std::min(limit, terms.size());
+        std::partial_sort(terms.begin(), terms.begin() + keep, terms.end(),
+                          [](const std::pair<std::string, unsigned long long> &a,
+                             const std::pair<std::string, unsigned long long> &b)
+                          {
+                              if (a.second != b.second)
+                                  return a.second > b.second;
+                              return a.first < b.first;
+                          });
+        terms.resize(keep);
+        return terms;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return counts.size();
+    }
+
+    // One "<term> <count>" line per term, most asked for first
+    bool write(const char *filename) const
+    {
+        std::ofstream file;
+        file.open(filename, std::ios::out);
+        for (const auto &term : top(size()))
+            file << term.first << " " << term.second << "\n";
+        file.close();
+        return bool(file);
+    }
+
+    // Adds the counts of a file written by write(), halved, so that terms asked for
+    // before the last restart weigh less than those asked for since
+    // Returns false if the file cannot be opened
+    bool read(const char *filename)
+    {
+        std::ifstream file;
+        file.open(filename, std::ios::in);
+        if (!file)
+            return false;
+        std::string term;
+        unsigned long long count;
+        std::lock_guard<std::mutex> guard(lock);
+        while (file >> term >> count)
+            counts[term] += (count + 1) / 2;
+        return true;
+    }
+
+private:
+    std::unordered_map<std::string, unsigned long long> counts;
+    mutable std::mutex lock;
+};
+
+#endif
@@ -0,0 +1,413 @@
+#pragma once
+#ifndef BLOCK_CACHE_HPP
+#define BLOCK_CACHE_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <fcntl.h>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A buffer pool: fixed-size blocks of read-only files, read on demand into a fixed
+// number of frames, so an index larger than memory is served from a bounded amount of it
+// Frames are replaced with 2Q (Johnson and Shasha): a block read for the first time
+// enters a FIFO that holds a quarter of the frames, and only a block asked for again
+// after it left the FIFO (remembered by a ghost list of recent evictions) enters the
+// LRU list of the rest. A long scan thus passes through the FIFO without flushing
+// the blocks that queries keep coming back to
+// A block stays in its frame while it is pinned; if every frame is pinned, pin()
+// reads the block into a buffer of its own that goes with the pin (an overflow),
+// so a cache that is too small gets slower but never fails a query
+// pin() may be called from several threads at once
+class BlockCache
+{
+public:
+    struct Stats
+    {
+        unsigned long long hits{0};
+        unsigned long long misses{0};     // blocks read from their file
+        unsigned long long evictions{0};
+        unsigned long long overflows{0};  // misses that found every frame pinned
+        unsigned long long bytes_read{0};
+
+        double hit_rate() const
+        {
+            return hits + misses ? double(hits) / (hits + misses) : 0;
+        }
+
+        void print(std::ostream &out) const
+        {
+            out << "Block cache: " << hits << " hits, " << misses << " misses ("
+                << 100 * hit_rate() << "% hit rate), " << evictions << " evictions, "
+                << overflows << " overflows, " << bytes_read << " bytes read\n";
+        }
+    };
+
+    // A block held in memory until the pin is released or goes away
+    class Pin
+    {
+    public:
+        Pin() = default;
+        Pin(const Pin &) = delete;
+        Pin &operator=(const Pin &) = delete;
+
+        Pin(Pin &&other) noexcept
+        {
+            *this = std::move(other);
+        }
+
+        Pin &operator=(Pin &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                std::swap(cache, other.cache);
+                std::swap(frame, other.frame);
+                std::swap(key, other.key);
+                std::swap(start, other.start);
+                std::swap(length, other.length);
+                std::swap(own, other.own);
+            }
+            return *this;
+        }
+
+        ~Pin()
+        {
+            release();
+        }
+
+        explicit operator bool() const { return start != nullptr; }
+        const char *data() const { return start; }
+        size_t size() const { return length; } // less than the block size at the end of a file
+
+        // True if this pins the given block of the given file
+        bool holds(const int &file, const unsigned long long &block) const
+        {
+            return start && key == BlockCache::key_of(file, block);
+        }
+
+        void release()
+        {
+            if (cache)
+                cache->unpin(frame);
+            cache = nullptr;
+            own.reset();
+            start = nullptr;
+            length = 0;
+        }
+
+    private:
+        friend class BlockCache;
+        BlockCache *cache{0}; // null for an overflow, which owns its buffer
+        unsigned frame{0};
+        unsigned long long key{0};
+        const char *start{0};
+        size_t length{0};
+        std::unique_ptr<char[]> own;
+    };
+
+    // capacity_bytes is rounded down to whole blocks; block_size must be a multiple of 8
+    BlockCache(const size_t &capacity_bytes, const size_t &block_size = 1 << 14)
+        : block(block_size), frames(capacity_bytes / block_size), memory(new char[frames.size() * block_size]),
+          in_limit(std::max<size_t>(1, frames.size() / 4)), out_limit(std::max<size_t>(1, frames.size() / 2))
+    {
+        for (unsigned f = frames.size(); f-- > 0;)
+            free_frames.push_back(f);
+    }
+
+    BlockCache(const BlockCache &) = delete;
+    BlockCache &operator=(const BlockCache &) = delete;
+
+    // Pins must not outlive the cache
+    ~BlockCache()
+    {
+        for (const auto &file : files)
+            ::close(file.first);
+    }
+
+    // Opens a file for pin(); returns its number, or -1 if it cannot be opened
+    int add_file(const std::string &filename)
+    {
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return -1;
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        files.emplace_back(fd, info.st_size);
+        return files.size() - 1;
+    }
+
+    unsigned long long file_size(const int &file) const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return file >= 0 && size_t(file) < files.size() ? files[file].second : 0;
+    }
+
+    size_t block_size() const { return block; }
+    size_t capacity() const { return frames.size() * block; }
+
+    // Pins block number block of a file (the bytes from block * block_size() on)
+    // Returns an empty pin if the block is past the end of the file or cannot be read
+    Pin pin(const int &file, const unsigned long long &block_number)
+    {
+        Pin pin;
+        const unsigned long long key = key_of(file, block_number);
+        std::unique_lock<std::mutex> guard(lock);
+        if (file < 0 || size_t(file) >= files.size() || block_number * block >= files[file].second)
+            return pin;
+        const int fd = files[file].first;
+        const unsigned long long offset = block_number * block;
+
+        for (auto found = resident.find(key); found != resident.end(); found = resident.find(key))
+        {
+            Frame &frame = frames[found->second];
+            if (frame.loading)
+            {
+                loaded.wait(guard);
+                continue;
+            }
+            frame.pins++;
+            stats_now.hits++;
+            if (frame.queue == AM)
+                am.splice(am.begin(), am, frame.place); // a hit in the FIFO does not move it
+            return pinned(found->second, key);
+        }
+
+        stats_now.misses++;
+        const int f = take_frame();
+        if (f < 0)
+        {
+            stats_now.overflows++;
+            guard.unlock();
+            pin.own.reset(new char[block]);
+            const ssize_t n = pread(fd, pin.own.get(), block, offset);
+            if (n <= 0)
+            {
+                pin.own.reset();
+                return pin;
+            }
+            pin.key = key;
+            pin.start = pin.own.get();
+            pin.length = n;
+            guard.lock();
+            stats_now.bytes_read += n;
+            return pin;
+        }
+
+        Frame &frame = frames[f];
+        frame.key = key;
+        frame.pins = 1;
+        frame.loading = true;
+        resident[key] = f;
+        auto ghost = ghosts.find(key);
+        if (ghost != ghosts.end())
+        {
+            // Asked for again soon after it was evicted from the FIFO: it is hot
+            a1out.erase(ghost->second);
+            ghosts.erase(ghost);
+            am.push_front(f);
+            frame.queue = AM;
+            frame.place = am.begin();
+        }
+        else
+        {
+            a1in.push_front(f);
+            frame.queue = A1IN;
+            frame.place = a1in.begin();
+        }
+
+        guard.unlock();
+        const ssize_t n = pread(fd, memory.get() + size_t(f) * block, block, offset);
+        guard.lock();
+        frame.loading = false;
+        loaded.notify_all();
+        if (n <= 0)
+        {
+            frame.pins = 0;
+            drop(f);
+            free_frames.push_back(f);
+            return pin;
+        }
+        frame.length = n;
+        stats_now.bytes_read += n;
+        return pinned(f, key);
+    }
+
+    // Reads a block in before anything asks for it, into the LRU list as if it had been
+    // asked for twice, so a scan does not push it out; nothing if it is already resident
+    // Returns the bytes read (0 also if the block is past the end of the file or every frame is pinned)
+    size_t warm(const int &file, const unsigned long long &block_number)
+    {
+        const unsigned long long key = key_of(file, block_number);
+        std::unique_lock<std::mutex> guard(lock);
+        if (file < 0 || size_t(file) >= files.size() || block_number * block >= files[file].second ||
+            resident.count(key))
+            return 0;
+        const int fd = files[file].first; // add_file() may move files once unlocked
+        const int f = take_frame();
+        if (f < 0)
+            return 0;
+        Frame &frame = frames[f];
+        frame.key = key;
+        frame.pins = 1;
+        frame.loading = true;
+        resident[key] = f;
+        am.push_front(f);
+        frame.queue = AM;
+        frame.place = am.begin();
+
+        guard.unlock();
+        const ssize_t n = pread(fd, memory.get() + size_t(f) * block, block, block_number * block);
+        guard.lock();
+        frame.loading = false;
+        frame.pins = 0;
+        loaded.notify_all();
+        if (n <= 0)
+        {
+            drop(f);
+            free_frames.push_back(f);
+            return 0;
+        }
+        frame.length = n;
+        stats_now.bytes_read += n;
+        return n;
+    }
+
+    // Frames that warm() may fill without pushing out blocks it read before
+    size_t warm_capacity() const
+    {
+        return (frames.size() - std::min(frames.size(), in_limit)) * block;
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        return stats_now;
+    }
+
+    void reset_stats()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stats_now = Stats();
+    }
+
+private:
+    enum Queue
+    {
+        NONE,
+        A1IN, // seen once, first in first out
+        AM    // seen again, least recently used last
+    };
+
+    struct Frame
+    {
+        unsigned long long key{0};
+        unsigned pins{0};
+        bool loading{false}; // being read; waiters sleep on loaded
+        size_t length{0};
+        Queue queue{NONE};
+        std::list<unsigned>::iterator place;
+    };
+
+    size_t block;
+    std::vector<Frame> frames;
+    std::unique_ptr<char[]> memory; // frame f is block bytes from f * block
+    size_t in_limit;                // frames the FIFO may hold before it gives them up first
+    size_t out_limit;               // evicted blocks remembered
+    std::vector<std::pair<int, unsigned long long>> files; // (descriptor, size)
+    std::vector<unsigned> free_frames;
+    std::unordered_map<unsigned long long, unsigned> resident; // key -> frame
+    std::list<unsigned> a1in, am;                              // frames, newest first
+    std::list<unsigned long long> a1out;                       // keys, newest first
+    std::unordered_map<unsigned long long, std::list<unsigned long long>::iterator> ghosts;
+    Stats stats_now;
+    mutable std::mutex lock;
+    std::condition_variable loaded;
+
+    static unsigned long long key_of(const int &file, const unsigned long long &block_number)
+    {
+        return (unsigned long long)file << 48 | block_number;
+    }
+
+    Pin pinned(const unsigned &f, const unsigned long long &key)
+    {
+        Pin pin;
+        pin.cache = this;
+        pin.frame = f;
+        pin.key = key;
+        pin.start = memory.get() + size_t(f) * block;
+        pin.length = frames[f].length;
+        return pin;
+    }
+
+    void unpin(const unsigned &f)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        frames[f].pins--;
+    }
+
+    // Takes a frame off its queue and out of resident
+    void drop(const unsigned &f)
+    {
+        Frame &frame = frames[f];
+        resident.erase(frame.key);
+        (frame.queue == AM ? am : a1in).erase(frame.place);
+        frame.queue = NONE;
+    }
+
+    // The oldest unpinned frame of a queue, or -1
+    int unpinned(const std::list<unsigned> &queue) const
+    {
+        for (auto f = queue.rbegin(); f != queue.rend(); ++f)
+        {
+            if (!frames[*f].pins && !frames[*f].loading)
+                return *f;
+        }
+        return -1;
+    }
+
+    // A free frame, else one evicted as 2Q says; -1 if every frame is pinned
+    int take_frame()
+    {
+        if (!free_frames.empty())
+        {
+            const unsigned f = free_frames.back();
+            free_frames.pop_back();
+            return f;
+        }
+        const bool from_fifo = a1in.size() > in_limit;
+        int f = unpinned(from_fifo ? a1in : am);
+        if (f < 0)
+            f = unpinned(from_fifo ? am : a1in);
+        if (f < 0)
+            return -1;
+        if (frames[f].queue == A1IN)
+        {
+            a1out.push_front(frames[f].key);
+            ghosts[frames[f].key] = a1out.begin();
+            if (a1out.size() > out_limit)
+            {
+                ghosts.erase(a1out.back());
+                a1out.pop_back();
+            }
+        }
+        drop(f);
+        stats_now.evictions++;
+        return f;
+    }
+};
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+#ifndef DISK_POSTINGS_HPP
+#define DISK_POSTINGS_HPP
+
+#include "BlockCache.hpp"
+#include <utility>
+#include <vector>
+
+#define DISK_SKIP (128) // pairs between the skips a DiskRun keeps in memory
+
+// Where a term's docs are when the index is disk-resident (see Indexer::read_blocks)
+// A block file holds every term's (doc ID, term freq) pairs, as two unsigned each,
+// one term after another; only this and the dictionary stay in memory, and the
+// pairs are read through a BlockCache as cursors get to them
+struct DiskRun
+{
+    BlockCache *cache{0};
+    int file{-1};
+    unsigned long long entry{0};     // the term's first pair, counted in pairs
+    unsigned long long positions{0}; // where its first doc's positions start in the positions file
+    // (doc ID, positions offset) of pair DISK_SKIP * (k + 1), so cursors can jump ahead
+    std::vector<std::pair<unsigned, unsigned long long>> skips;
+};
+
+#endif
@@ -0,0 +1,347 @@
+#pragma once
+#ifndef FILE_SOURCE_HPP
+#define FILE_SOURCE_HPP
+
+#include "Uring.hpp"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Reads whole files for the indexing pipeline
+// With thousands of small files the time goes into waiting on each open and read,
+// so instead of reading one file after another the sources keep many requests in flight:
+//   URING  one thread submits opens, reads and closes in batches through io_uring
+//   PREAD  a pool of threads, each blocked on its own open/pread
+//   SYNC   one file at a time (the old way)
+// AUTO is URING where the kernel can open, read and close through io_uring and PREAD otherwise
+// Every file is handed on as emit(index, text, read); a file that cannot be opened or read
+// is handed on with whatever text was read (maybe none) and read false
+// Files finish out of order, but none is started AHEAD or more files after the oldest
+// unfinished one, so a consumer putting them back in order holds at most AHEAD of them
+namespace FileSource
+{
+    enum Method
+    {
+        AUTO,
+        URING,
+        PREAD,
+        SYNC
+    };
+
+    inline const char *name(const Method &method)
+    {
+        switch (method)
+        {
+        case URING:
+            return "io_uring";
+        case PREAD:
+            return "pread";
+        case SYNC:
+            return "sync";
+        default:
+            return "auto";
+        }
+    }
+
+    const unsigned IN_FLIGHT = 64;      // files open at once
+    const unsigned READ_SIZE = 1 << 16; // bytes asked for by a file's first read
+    const unsigned AHEAD = 4 * IN_FLIGHT;
+
+    // Returns false if the file cannot be opened or read
+    inline bool read_whole(const std::string &filename, std::string &text)
+    {
+        text.clear();
+        FILE *file = fopen(filename.c_str(), "rb");
+        if (!file)
+            return false;
+        char buffer[READ_SIZE];
+        size_t got;
+        while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            text.append(buffer, got);
+        const bool read = !ferror(file);
+        fclose(file);
+        return read;
+    }
+
+    // One file at a time on the calling thread
+    template <typename Emit>
+    void read_sync(const std::vector<std::pair<std::string, unsigned>> &files, Emit emit)
+    {
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            std::string text;
+            const bool read = read_whole(files[i].first, text);
+            emit(i, std::move(text), read);
+        }
+    }
+
+    // threads workers take the next file from a shared counter; emit is called from all of them
+    template <typename Emit>
+    void read_pread(const std::vector<std::pair<std::string, unsigned>> &files, Emit emit,
+                    const unsigned &threads = IN_FLIGHT / 4)
+    {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> oldest{0}; // first file not yet handed on
+        std::vector<bool> emitted(files.size(), false);
+        std::mutex lock;
+        auto work = [&]()
+        {
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < files.size();)
+            {
+                while (i >= oldest.load(std::memory_order_acquire) + AHEAD)
+                    std::this_thread::yield(); // the thread with the oldest file is still reading
+                std::string text;
+                bool read = false;
+                const int fd = open(files[i].first.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0)
+                {
+                    struct stat info;
+                    size_t size = fstat(fd, &info) == 0 && info.st_size > 0 ? info.st_size : READ_SIZE;
+                    size_t offset = 0;
+                    while (true)
+                    {
+                        if (offset == size)
+                            size *= 2; // the file grew, or its size was unknown
+                        text.resize(size);
+                        const ssize_t got = pread(fd, &text[offset], size - offset, offset);
+                        read = got == 0;
+                        if (got <= 0)
+                            break;
+                        offset += got;
+                    }
+                    text.resize(offset);
+                    close(fd);
+                }
+                emit(i, std::move(text), read);
+                std::lock_guard<std::mutex> guard(lock);
+                emitted[i] = true;
+                size_t first = oldest.load(std::memory_order_relaxed);
+                while (first < files.size() && emitted[first])
+                    first++;
+                oldest.store(first, std::memory_order_release);
+            }
+        };
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threads; t++)
+            workers.emplace_back(work);
+        work();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    // Every file goes open -> read (-> read until a read returns nothing) -> close, each step
+    // one ring entry; up to IN_FLIGHT files move through their steps at the same time
+    // and one io_uring_enter submits the next batch and reaps the last
+    // Returns false without reading anything if io_uring is unavailable, or too old to
+    // open, read and close files
+    // If the ring breaks part way, the files it has not handed on are read one at a time
+    template <typename Emit>
+    bool read_uring(const std::vector<std::pair<std::string, unsigned>> &files, Emit emit)
+    {
+        enum Step
+        {
+            FREE,
+            OPENING,
+            READING,
+            CLOSING
+        };
+        struct Slot
+        {
+            Step step{FREE};
+            size_t file{0};
+            int fd{-1};
+            std::string text;
+            size_t offset{0}; // bytes read so far
+            bool failed{false};
+        };
+        std::vector<Slot> slots(IN_FLIGHT);
+        std::vector<unsigned> free_slots;
+        std::vector<bool> emitted(files.size(), false);
+        size_t next = 0;   // files not yet opened start here
+        size_t oldest = 0; // first file not yet handed on
+        unsigned busy = 0; // slots not free
+        for (unsigned s = IN_FLIGHT; s > 0; s--)
+            free_slots.push_back(s - 1);
+
+        // Every slot has at most one entry in the ring, so the ring never fills up
+        // Declared after the slots, so it is torn down before their buffers are freed
+        Uring ring(IN_FLIGHT);
+        if (!ring.ok() || !ring.supports(IORING_OP_OPENAT) || !ring.supports(IORING_OP_READ) ||
+            !ring.supports(IORING_OP_CLOSE))
+            return false;
+
+        auto read = [&](const unsigned &s)
+        {
+            Slot &slot = slots[s];
+            slot.step = READING;
+            if (slot.text.size() == slot.offset)
+                slot.text.resize(slot.offset ? 2 * slot.offset : READ_SIZE);
+            io_uring_sqe *sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = slot.fd;
+            sqe->addr = (unsigned long long)&slot.text[slot.offset];
+            sqe->len = slot.text.size() - slot.offset;
+            sqe->off = slot.offset;
+            sqe->user_data = s;
+        };
+        auto finish = [&](const unsigned &s)
+        {
+            Slot &slot = slots[s];
+            slot.text.resize(slot.offset);
+            emitted[slot.file] = true;
+            emit(slot.file, std::move(slot.text), !slot.failed);
+            slot.text = std::string();
+            if (slot.fd < 0)
+            {
+                slot.step = FREE;
+                free_slots.push_back(s);
+                busy--;
+                return;
+            }
+            slot.step = CLOSING;
+            io_uring_sqe *sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = slot.fd;
+            sqe->user_data = s;
+        };
+
+        while (next < files.size() || busy)
+        {
+            while (oldest < files.size() && emitted[oldest])
+                oldest++;
+            while (next < files.size() && next < oldest + AHEAD && !free_slots.empty())
+            {
+                const unsigned s = free_slots.back();
+                free_slots.pop_back();
+                Slot &slot = slots[s];
+                slot.step = OPENING;
+                slot.file = next++;
+                slot.fd = -1;
+                slot.offset = 0;
+                slot.failed = false;
+                io_uring_sqe *sqe = ring.get_sqe();
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = (unsigned long long)files[slot.file].first.c_str();
+                sqe->open_flags = O_RDONLY | O_CLOEXEC;
+                sqe->user_data = s;
+                busy++;
+            }
+
+            if (!ring.submit(1))
+            {
+                if (errno == EINTR)
+                    continue;
+                // The entries the kernel took may still read into the slots' buffers or
+                // open files, so they are waited for before the ring is given up
+                unsigned in_flight = busy - ring.unsubmitted();
+                while (in_flight)
+                {
+                    if (!ring.wait(1))
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        break;
+                    }
+                    in_flight -= ring.for_each_completion([&](const unsigned long long &user_data, const int &result)
+                    {
+                        Slot &slot = slots[user_data];
+                        if (slot.step == OPENING)
+                            slot.fd = result; // negative if the open failed
+                        else if (slot.step == CLOSING)
+                            slot.fd = -1;
+                        slot.step = FREE;
+                    });
+                }
+                // Once every entry taken is done, a slot still closing never had its close
+                // taken; otherwise it may be in flight and its fd is left alone
+                for (const auto &slot : slots)
+                    if (slot.fd >= 0 && (slot.step != CLOSING || !in_flight))
+                        close(slot.fd);
+                for (size_t i = 0; i < files.size(); i++)
+                    if (!emitted[i])
+                    {
+                        std::string text;
+                        const bool ok = read_whole(files[i].first, text);
+                        emit(i, std::move(text), ok);
+                    }
+                return true;
+            }
+
+            ring.for_each_completion([&](const unsigned long long &user_data, const int &result)
+            {
+                const unsigned s = user_data;
+                Slot &slot = slots[s];
+                switch (slot.step)
+                {
+                case OPENING:
+                    if (result < 0)
+                    {
+                        slot.failed = true;
+                        finish(s);
+                    }
+                    else
+                    {
+                        slot.fd = result;
+                        read(s);
+                    }
+                    break;
+                case READING:
+                    if (result <= 0)
+                    {
+                        slot.failed = result < 0;
+                        finish(s); // end of file, or an error
+                    }
+                    else
+                    {
+                        // A read may return less than asked for before the end, so
+                        // as with pread only an empty read ends the file
+                        slot.offset += result;
+                        read(s);
+                    }
+                    break;
+                case CLOSING:
+                    slot.step = FREE;
+                    free_slots.push_back(s);
+                    busy--;
+                    break;
+                default:
+                    break;
+                }
+            });
+        }
+        return true;
+    }
+
+    // Calls emit(index into files, text, read) once for every file, in any order and maybe
+    // from several threads; returns the method used and sets threads to how many read
+    template <typename Emit>
+    Method read(const std::vector<std::pair<std::string, unsigned>> &files, Emit emit,
+                Method method, unsigned &threads)
+    {
+        threads = 1;
+        if (method == AUTO || method == URING)
+        {
+            if (read_uring(files, emit))
+                return URING;
+            method = PREAD;
+        }
+        if (method == PREAD)
+        {
+            threads = IN_FLIGHT / 4;
+            read_pread(files, emit, threads);
+            return PREAD;
+        }
+        read_sync(files, emit);
+        return SYNC;
+    }
+}
+
+#endif
@@ -0,0 +1,390 @@
+#pragma once
+#ifndef FORWARD_STORE_HPP
+#define FORWARD_STORE_HPP
+
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The docs themselves, so results can be shown without opening ../Dataset again
+// Every doc keeps its metadata (external ID, path, length) and its token stream:
+// the text cut at every space and newline (dropping the \r of a \r\n), so token k
+// is the word at position k
+// Tokens are numbered by how common they are and stored as variable-byte numbers
+// in blocks of BLOCK_TOKENS, each starting a doc or BLOCK_TOKENS tokens into it,
+// so any position is at most a block's decoding away
+// The file is one mapping:
+//   Header
+//   unsigned long long block_offsets[blocks + 1]   where each block starts in the stream
+//   Entry              docs[entries]               by internal doc ID
+//   unsigned           word_offsets[words + 1]     where each token's characters start
+//   char               words[word_bytes], paths[path_bytes]
+//   unsigned char      stream[stream_bytes]
+class ForwardStore
+{
+public:
+    static const unsigned BLOCK_TOKENS = 128;
+
+    struct Header
+    {
+        char magic[4]{'F', 'W', 'D', '1'};
+        unsigned entries{0}; // highest doc ID + 1
+        unsigned words{0};
+        unsigned block_tokens{BLOCK_TOKENS};
+        unsigned long long blocks{0};
+        unsigned long long word_bytes{0};
+        unsigned long long path_bytes{0};
+        unsigned long long stream_bytes{0};
+    };
+
+    struct Entry
+    {
+        unsigned external_ID{0}; // 0 if the doc is not stored
+        unsigned tokens{0};
+        unsigned first_block{0};
+        unsigned path_offset{0};
+        unsigned path_length{0};
+    };
+
+    // Collects docs while they are indexed and writes them out
+    class Builder
+    {
+    public:
+        // Docs may come in any order; a doc added again replaces the earlier one
+        void add(const unsigned &ID, const unsigned &external_ID, const std::string &path, const std::string &text)
+        {
+            Doc &doc = docs[ID];
+            doc.external_ID = external_ID;
+            doc.path = path;
+            doc.tokens.clear();
+            size_t from = 0;
+            for (size_t i = 0; i <= text.size(); i++)
+            {
+                if (i < text.size() && text[i] != ' ' && text[i] != '\n')
+                    continue;
+                size_t to = i;
+                if (to > from && text[to - 1] == '\r')
+                    to--;
+                doc.tokens.push_back(word_ID(std::string_view(text.data() + from, to - from)));
+                from = i + 1;
+            }
+        }
+
+        // Gives the docs new IDs (see Reorder::bisection)
+        void renumber(const std::vector<unsigned> &new_ID)
+        {
+            std::unordered_map<unsigned, Doc> renumbered;
+            for (auto &doc : docs)
+                renumbered[doc.first < new_ID.size() ? new_ID[doc.first] : doc.first] = std::move(doc.second);
+            docs = std::move(renumbered);
+        }
+
+        size_t size() const
+        {
+            return docs.size();
+        }
+
+        void clear()
+        {
+            docs.clear();
+            IDs.clear();
+            words.clear();
+            counts.clear();
+        }
+
+        // Returns false if the file cannot be written
+        bool write(const char *filename) const
+        {
+            // The most common tokens get the smallest numbers, so most take one byte
+            std::vector<unsigned> order(words.size());
+            for (unsigned w = 0; w < order.size(); w++)
+                order[w] = w;
+            std::sort(order.begin(), order.end(),
+                      [this](const unsigned &a, const unsigned &b)
+                      { return counts[a] != counts[b] ? counts[a] > counts[b] : a < b; });
+            std::vector<unsigned> rank(words.size());
+            for (unsigned r = 0; r < order.size(); r++)
+                rank[order[r]] = r;
+
+            Header header;
+            header.words = words.size();
+            unsigned max_ID = 0;
+            for (const auto &doc : docs)
+                max_ID = std::max(max_ID, doc.first);
+            header.entries = docs.empty() ? 0 : max_ID + 1;
+
+            std::vector<Entry> entries(header.entries);
+            std::vector<unsigned long long> block_offsets;
+            std::string paths;
+            std::vector<unsigned char> stream;
+            for (unsigned ID = 0; ID < header.entries; ID++)
+            {
+                auto found = docs.find(ID);
+                if (found == docs.end())
+                    continue;
+                const Doc &doc = found->second;
+                Entry &entry = entries[ID];
+                entry.external_ID = doc.external_ID;
+                entry.tokens = doc.tokens.size();
+                entry.first_block = block_offsets.size();
+                entry.path_offset = paths.size();
+                entry.path_length = doc.path.size();
+                paths += doc.path;
+                for (size_t i = 0; i < doc.tokens.size(); i++)
+                {
+                    if (i % BLOCK_TOKENS == 0)
+                        block_offsets.push_back(stream.size());
+                    unsigned value = rank[doc.tokens[i]];
+                    while (value >= 128)
+                    {
+                        stream.push_back((value & 127) | 128);
+                        value >>= 7;
+                    }
+                    stream.push_back(value);
+                }
+            }
+            header.blocks = block_offsets.size();
+            block_offsets.push_back(stream.size());
+
+            std::vector<unsigned> word_offsets{0};
+            std::string chars;
+            for (const unsigned &w : order)
+            {
+                chars += words[w];
+                word_offsets.push_back(chars.size());
+            }
+            header.word_bytes = chars.size();
+            header.path_bytes = paths.size();
+            header.stream_bytes = stream.size();
+
+            std::ofstream file(filename, std::ios::out | std::ios::binary);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char *>(block_offsets.data()), block_offsets.size() * sizeof(unsigned long long));
+            file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+            file.write(reinterpret_cast<const char *>(word_offsets.data()), word_offsets.size() * sizeof(unsigned));
+            file.write(chars.data(), chars.size());
+            file.write(paths.data(), paths.size());
+            file.write(reinterpret_cast<const char *>(stream.data()), stream.size());
+            return bool(file);
+        }
+
+    private:
+        struct Doc
+        {
+            unsigned external_ID{0};
+            std::string path;
+            std::vector<unsigned> tokens; // numbered in order of first sight
+        };
+
+        std::unordered_map<unsigned, Doc> docs;
+        std::deque<std::string> words; // do not move, so IDs can point into them
+        std::unordered_map<std::string_view, unsigned> IDs;
+        std::vector<unsigned long long> counts;
+
+        unsigned word_ID(const std::string_view &token)
+        {
+            auto found = IDs.find(token);
+            if (found == IDs.end())
+            {
+                words.emplace_back(token);
+                counts.push_back(0);
+                found = IDs.emplace(words.back(), words.size() - 1).first;
+            }
+            counts[found->second]++;
+            return found->second;
+        }
+    };
+
+    ForwardStore() = default;
+    ForwardStore(const ForwardStore &) = delete;
+    ForwardStore &operator=(const ForwardStore &) = delete;
+
+    // Returns false if the file is missing or is not a whole forward store
+    bool open(const std::string &filename)
+    {
+        close();
+        // snippets read a few blocks anywhere in the file
+        if (!file.open(filename, MADV_RANDOM) || file.size() < sizeof(Header))
+            return fail();
+        std::memcpy(&header, file.data(), sizeof(Header));
+        if (std::memcmp(header.magic, "FWD1", 4) != 0 || header.block_tokens != BLOCK_TOKENS)
+            return fail();
+
+        const unsigned long long expected = sizeof(Header)
+                                            + (header.blocks + 1) * sizeof(unsigned long long)
+                                            + header.entries * sizeof(Entry)
+                                            + (header.words + 1ull) * sizeof(unsigned)
+                                            + header.word_bytes + header.path_bytes + header.stream_bytes;
+        if (file.size() != expected)
+            return fail();
+        const char *at = file.data() + sizeof(Header);
+        block_offsets = reinterpret_cast<const unsigned long long *>(at);
+        at += (header.blocks + 1) * sizeof(unsigned long long);
+        entries = reinterpret_cast<const Entry *>(at);
+        at += header.entries * sizeof(Entry);
+        word_offsets = reinterpret_cast<const unsigned *>(at);
+        at += (header.words + 1ull) * sizeof(unsigned);
+        words = at;
+        paths = words + header.word_bytes;
+        stream = reinterpret_cast<const unsigned char *>(paths + header.path_bytes);
+
+        for (unsigned ID = 0; ID < header.entries; ID++)
+        {
+            const unsigned external = entries[ID].external_ID;
+            if (!external)
+                continue;
+            if (external >= internal_IDs.size())
+                internal_IDs.resize(external + 1, 0);
+            internal_IDs[external] = ID;
+            stored++;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        header = Header();
+        internal_IDs.clear();
+        stored = 0;
+    }
+
+    bool is_open() const { return file.is_open(); }
+
+    // Docs stored
+    unsigned size() const { return stored; }
+
+    // Bytes of the mapping
+    size_t bytes() const { return file.size(); }
+
+    bool has(const unsigned &ID) const
+    {
+        return ID < header.entries && entries[ID].external_ID != 0;
+    }
+
+    // The internal ID of a doc given by its external ID; 0 if it is not stored
+    unsigned internal_ID(const unsigned &external_ID) const
+    {
+        return external_ID < internal_IDs.size() ? internal_IDs[external_ID] : 0;
+    }
+
+    // Metadata of a stored doc (see has())
+    unsigned external_ID(const unsigned &ID) const { return entries[ID].external_ID; }
+    unsigned length(const unsigned &ID) const { return entries[ID].tokens; }
+    std::string path(const unsigned &ID) const
+    {
+        return std::string(paths + entries[ID].path_offset, entries[ID].path_length);
+    }
+
+    // Tokens first..first + count - 1 of a stored doc joined by spaces (fewer at its end)
+    std::string text(const unsigned &ID, const unsigned &first = 0, const unsigned &count = ~0u) const
+    {
+        std::string out;
+        const unsigned last = std::min<unsigned long long>(entries[ID].tokens, (unsigned long long)first + count);
+        for_each_token(ID, first, last, [&](const unsigned &pos, const char *chars, const size_t &length)
+        {
+            if (pos > first)
+                out.push_back(' ');
+            out.append(chars, length);
+        });
+        return out;
+    }
+
+    // Keyword in context: the 2 * context + 1 tokens of a stored doc around the most
+    // of the given (ascending) positions, with those tokens in [brackets] and "..."
+    // where the doc goes on
+    std::string snippet(const unsigned &ID, const std::vector<unsigned> &positions, const unsigned &context = 8) const
+    {
+        const unsigned tokens = entries[ID].tokens;
+        const unsigned width = 2 * context + 1;
+        // The window that holds the most positions, centred on them
+        unsigned first = 0;
+        size_t best = 0;
+        for (size_t i = 0, j = 0; i < positions.size(); i++)
+        {
+            while (positions[j] + width <= positions[i])
+                j++;
+            if (i - j + 1 > best)
+            {
+                best = i - j + 1;
+                const unsigned middle = positions[j] + (positions[i] - positions[j]) / 2;
+                first = middle > context ? middle - context : 0;
+            }
+        }
+        if (first + width > tokens)
+            first = tokens > width ? tokens - width : 0;
+        const unsigned last = std::min(tokens, first + width);
+
+        std::string out = first > 0 ? "..." : "";
+        size_t next = std::lower_bound(positions.begin(), positions.end(), first) - positions.begin();
+        for_each_token(ID, first, last, [&](const unsigned &pos, const char *chars, const size_t &length)
+        {
+            if (length == 0)
+                return;
+            const bool matched = next < positions.size() && positions[next] == pos;
+            if (matched)
+                next++;
+            if (!out.empty() && out != "...")
+                out.push_back(' ');
+            if (matched)
+                out.push_back('[');
+            out.append(chars, length);
+            if (matched)
+                out.push_back(']');
+        });
+        if (last < tokens)
+            out += "...";
+        return out;
+    }
+
+private:
+    MappedFile file;
+    Header header;
+    const unsigned long long *block_offsets{0};
+    const Entry *entries{0};
+    const unsigned *word_offsets{0};
+    const char *words{0};
+    const char *paths{0};
+    const unsigned char *stream{0};
+    std::vector<unsigned> internal_IDs; // by external ID
+    unsigned stored{0};
+
+    bool fail()
+    {
+        close();
+        return false;
+    }
+
+    // Calls visit(position, characters, length) for tokens first..last - 1 of a doc,
+    // decoding from the block that holds first
+    template <typename Visitor>
+    void for_each_token(const unsigned &ID, const unsigned &first, const unsigned &last, Visitor visit) const
+    {
+        if (first >= last)
+            return;
+        const unsigned long long block = entries[ID].first_block + first / BLOCK_TOKENS;
+        const unsigned char *p = stream + block_offsets[block];
+        for (unsigned pos = first - first % BLOCK_TOKENS; pos < last; pos++)
+        {
+            unsigned value = 0;
+            for (unsigned shift = 0;; shift += 7)
+            {
+                const unsigned char byte = *p++;
+                value |= unsigned(byte & 127) << shift;
+                if (byte < 128)
+                    break;
+            }
+            if (pos >= first && value < header.words)
+                visit(pos, words + word_offsets[value], word_offsets[value + 1] - word_offsets[value]);
+        }
+    }
+};
+
+#endif
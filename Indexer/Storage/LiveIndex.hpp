@@ -0,0 +1,149 @@
+#pragma once
+#ifndef LIVE_INDEX_HPP
+#define LIVE_INDEX_HPP
+
+#include "../Indexer.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <signal.h>
+#include <thread>
+
+// An index that can be replaced by a newer generation while it is being queried
+// A query takes a snapshot with current() and uses it for its whole run, so it
+// sees one generation throughout. reload() builds the next generation aside,
+// publishes it with an atomic pointer swap (queries never wait on a load) and frees
+// the old one only after the last snapshot of it is released
+class LiveIndex
+{
+public:
+    // Fills a fresh Indexer (read files, set budgets, ...); returns false on failure
+    using Loader = std::function<bool(Indexer &)>;
+
+    LiveIndex(Loader loader)
+        : loader(std::move(loader)) {}
+
+    LiveIndex(const LiveIndex &) = delete;
+    LiveIndex &operator=(const LiveIndex &) = delete;
+
+    ~LiveIndex()
+    {
+        if (watcher.joinable())
+        {
+            stopping = true;
+            pthread_kill(watcher.native_handle(), watched_signal);
+            watcher.join();
+        }
+        std::thread last;
+        {
+            std::lock_guard<std::mutex> guard(async_lock);
+            pending = false;
+            last = std::move(background);
+        }
+        if (last.joinable())
+            last.join();
+    }
+
+    // The generation to run a query on; it stays valid for as long as it is held
+    // Null until the first successful reload()
+    std::shared_ptr<Indexer> current() const
+    {
+        return std::atomic_load(&snapshot);
+    }
+
+    // Loads a new generation and publishes it
+    // Returns false (and keeps serving the current generation) if loading fails
+    // Returns once the previous generation has been freed, i.e. once every query
+    // that was running on it has finished
+    bool reload()
+    {
+        std::lock_guard<std::mutex> guard(reload_lock); // one load at a time
+
+        std::shared_ptr<Indexer> next = std::make_shared<Indexer>();
+        if (!loader(*next))
+        {
+            failures++;
+            return false;
+        }
+        std::shared_ptr<Indexer> previous = std::atomic_exchange(&snapshot, next);
+        generations++;
+
+        // Retire the old generation here rather than in whichever query lets go of it last
+        while (previous && previous.use_count() > 1)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        previous.reset();
+        return true;
+    }
+
+    // reload() on a background thread; returns at once
+    // A request made while a reload is running starts another one after it
+    void reload_async()
+    {
+        std::lock_guard<std::mutex> guard(async_lock);
+        if (busy)
+        {
+            pending = true;
+            return;
+        }
+        if (background.joinable())
+            background.join();
+        busy = true;
+        background = std::thread([this]()
+        {
+            while (true)
+            {
+                reload();
+                std::lock_guard<std::mutex> guard(async_lock);
+                if (!pending)
+                {
+                    busy = false;
+                    return;
+                }
+                pending = false;
+            }
+        });
+    }
+
+    // Reloads whenever the process receives signal (e.g. kill -HUP)
+    // Call this before starting any other thread: the signal is blocked in the
+    // calling thread and in every thread it creates afterwards, so only the watcher gets it
+    void reload_on_signal(const int &signal = SIGHUP)
+    {
+        watched_signal = signal;
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, signal);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+        watcher = std::thread([this, set]()
+        {
+            int received;
+            while (sigwait(&set, &received) == 0 && !stopping)
+                reload_async();
+        });
+    }
+
+    // How many generations were published and how many loads failed
+    unsigned long long generation() const { return generations; }
+    unsigned long long failed_reloads() const { return failures; }
+
+private:
+    Loader loader;
+    std::shared_ptr<Indexer> snapshot; // only accessed through std::atomic_* functions
+    std::atomic<unsigned long long> generations{0};
+    std::atomic<unsigned long long> failures{0};
+    std::mutex reload_lock;
+
+    std::mutex async_lock; // guards background, busy and pending
+    std::thread background;
+    bool busy{false};
+    bool pending{false};
+
+    std::thread watcher;
+    int watched_signal{SIGHUP};
+    std::atomic<bool> stopping{false};
+};
+
+#endif
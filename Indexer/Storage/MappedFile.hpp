@@ -0,0 +1,80 @@
+#pragma once
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <algorithm>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    // Maps the file; advice is passed to madvise (e.g. MADV_SEQUENTIAL)
+    // Returns false if the file cannot be opened, is empty or cannot be mapped
+    bool open(const std::string &filename, const int &advice = MADV_NORMAL)
+    {
+        close();
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *region = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (region == MAP_FAILED)
+            return false;
+
+        madvise(region, st.st_size, advice);
+        start = static_cast<const char *>(region);
+        length = st.st_size;
+        return true;
+    }
+
+    // Asks the kernel to start reading the bytes from offset on (MADV_WILLNEED), as
+    // the advice given to open() may have turned readahead off; returns the bytes asked for
+    size_t will_need(const size_t &offset, const size_t &count) const
+    {
+        if (!start || offset >= length)
+            return 0;
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t from = offset / page * page, until = std::min(length, offset + count);
+        madvise(const_cast<char *>(start) + from, until - from, MADV_WILLNEED);
+        return until - offset;
+    }
+
+    void close()
+    {
+        if (start)
+            munmap(const_cast<char *>(start), length);
+        start = nullptr;
+        length = 0;
+    }
+
+    const char *data() const { return start; }
+    size_t size() const { return length; }
+    bool is_open() const { return start != nullptr; }
+
+private:
+    const char *start{0};
+    size_t length{0};
+};
+
+#endif
@@ -0,0 +1,155 @@
+#pragma once
+#ifndef POSITIONS_FILE_HPP
+#define POSITIONS_FILE_HPP
+
+#include "BlockCache.hpp"
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// A read-only view of a positions file written by Trie::write_split
+// The file is only opened the first time a position is asked for,
+// so boolean queries never pay for it; at() may be called from several threads
+// It is mapped, unless it is read through a BlockCache to stay within a memory budget
+class PositionsFile
+{
+public:
+    // Keeps what at() returned readable: the pinned block it is in, or a copy
+    // of positions that span blocks. Valid until the next at() with it
+    struct Hold
+    {
+        BlockCache::Pin pin;
+        std::vector<unsigned> copy;
+    };
+
+    PositionsFile() = default;
+    PositionsFile(const PositionsFile &) = delete;
+    PositionsFile &operator=(const PositionsFile &) = delete;
+
+    ~PositionsFile()
+    {
+        close();
+    }
+
+    // Remembers which file to open; does not open it yet
+    // With a cache the file is read through it instead of being mapped
+    // Returns false if the file cannot be read (an empty filename detaches)
+    bool attach(const std::string &filename, BlockCache *cache = nullptr)
+    {
+        close();
+        this->filename = filename;
+        this->cache = cache;
+        return filename.empty() || access(filename.c_str(), R_OK) == 0;
+    }
+
+    bool attached() const { return !filename.empty(); }
+    bool mapped() const { return file.is_open(); }
+
+    // Returns the count positions starting at offset
+    // Returns nullptr if the file cannot be opened or the range is out of bounds
+    const unsigned *at(const unsigned long long &offset, const unsigned &count, Hold &hold)
+    {
+        if (!open_once())
+            return nullptr;
+        if (offset + count > length / sizeof(unsigned))
+            return nullptr;
+        if (!cache)
+            return reinterpret_cast<const unsigned *>(file.data()) + offset;
+
+        const size_t block = cache->block_size();
+        const unsigned long long begin = offset * sizeof(unsigned), end = (offset + count) * sizeof(unsigned);
+        const unsigned long long first = begin / block, last = count ? (end - 1) / block : first;
+        if (first == last)
+        {
+            if (!hold.pin.holds(cache_file, first))
+                hold.pin = cache->pin(cache_file, first);
+            if (!hold.pin || hold.pin.size() < end - first * block)
+                return nullptr;
+            return reinterpret_cast<const unsigned *>(hold.pin.data() + begin - first * block);
+        }
+        // Rare: the positions run on into the next block(s)
+        hold.copy.resize(count);
+        char *to = reinterpret_cast<char *>(hold.copy.data());
+        for (unsigned long long b = first; b <= last; b++)
+        {
+            hold.pin = cache->pin(cache_file, b);
+            const unsigned long long from = std::max(begin, b * block), until = std::min(end, (b + 1) * block);
+            if (!hold.pin || hold.pin.size() < until - b * block)
+                return nullptr;
+            std::memcpy(to, hold.pin.data() + from - b * block, until - from);
+            to += until - from;
+        }
+        hold.pin.release();
+        return hold.copy.data();
+    }
+
+    // Starts reading the count positions from offset on before at() asks for them:
+    // into the block cache, else into the page cache under the mapping
+    // Returns the bytes read or asked for; stops early once max_bytes are
+    unsigned long long prefetch(const unsigned long long &offset, const unsigned long long &count,
+                                const unsigned long long &max_bytes)
+    {
+        if (!open_once() || offset >= length / sizeof(unsigned))
+            return 0;
+        const unsigned long long begin = offset * sizeof(unsigned);
+        const unsigned long long end = begin + std::min(length / sizeof(unsigned) - offset, count) * sizeof(unsigned);
+        if (!cache)
+            return file.will_need(begin, std::min(end - begin, max_bytes));
+        unsigned long long bytes = 0;
+        for (unsigned long long b = begin / cache->block_size(); b * cache->block_size() < end && bytes < max_bytes; b++)
+            bytes += cache->warm(cache_file, b);
+        return bytes;
+    }
+
+    // Bytes of the mapping (0 until it is mapped)
+    size_t bytes() const
+    {
+        return file.size();
+    }
+
+    void close()
+    {
+        file.close();
+        cache = nullptr;
+        cache_file = -1;
+        length = 0;
+        ready.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    std::string filename;
+    MappedFile file;
+    BlockCache *cache{0};
+    int cache_file{-1};
+    unsigned long long length{0}; // bytes
+    std::atomic<bool> ready{false}; // file is mapped
+    std::mutex opening;
+
+    // Opens the file the first time it is needed; false if it cannot be
+    bool open_once()
+    {
+        if (ready.load(std::memory_order_acquire))
+            return true;
+        std::lock_guard<std::mutex> guard(opening);
+        if (ready.load(std::memory_order_relaxed))
+            return true;
+        if (cache)
+        {
+            if (cache_file < 0 && (filename.empty() || (cache_file = cache->add_file(filename)) < 0))
+                return false;
+            length = cache->file_size(cache_file);
+        }
+        // phrase lookups jump around the file
+        else if (!file.is_open() && (filename.empty() || !file.open(filename, MADV_RANDOM)))
+            return false;
+        else
+            length = file.size();
+        ready.store(true, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,180 @@
+#pragma once
+#ifndef TEXT_LOADER_HPP
+#define TEXT_LOADER_HPP
+
+#include "MappedFile.hpp"
+#include "../Tries/Trie.hpp"
+#include "../Stats/Memory.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Loads an index.txt written by Trie::write in parallel
+// The file is mapped, cut into chunks at line boundaries and every chunk
+// is parsed on its own thread into one Posting per term line
+// The postings are then linked into the dictionary on the calling thread
+class TextLoader
+{
+public:
+    using Parsed = std::vector<std::pair<std::string, Posting *>>;
+
+    // Returns false if the file cannot be mapped or does not fit in budget
+    // Without positions only doc IDs and term frequencies are kept
+    static bool load(const char *filename, Trie &dictionary, unsigned threads = 0,
+                     MemoryBudget *budget = nullptr, const bool &with_positions = true)
+    {
+        MappedFile file;
+        if (!file.open(filename, MADV_SEQUENTIAL))
+            return false;
+
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        const char *begin = file.data();
+        const char *end = begin + file.size();
+
+        // Chunk boundaries always sit just after a '\n'
+        std::vector<const char *> cuts{begin};
+        for (unsigned i = 1; i < threads; i++)
+        {
+            const char *cut = begin + file.size() / threads * i;
+            if (cut <= cuts.back())
+                continue;
+            while (cut < end && cut[-1] != '\n')
+                cut++;
+            if (cut < end)
+                cuts.push_back(cut);
+        }
+        cuts.push_back(end);
+
+        const size_t chunks = cuts.size() - 1;
+        std::vector<Parsed> parsed(chunks);
+        std::vector<std::thread> workers;
+        Limits limits{budget, with_positions};
+        for (size_t i = 1; i < chunks; i++)
+            workers.emplace_back(parse, cuts[i], cuts[i + 1], std::ref(parsed[i]), std::ref(limits));
+        parse(cuts[0], cuts[1], parsed[0], limits);
+        for (auto &worker : workers)
+            worker.join();
+
+        if (limits.failed)
+        {
+            discard(parsed, 0, 0);
+            return false;
+        }
+
+        // Chunks are in file order, so terms are still inserted alphabetically
+        for (size_t c = 0; c < chunks; c++)
+        {
+            for (size_t t = 0; t < parsed[c].size(); t++)
+            {
+                auto &term = parsed[c][t];
+                unsigned long long tables = dictionary.table_count();
+                HashEntry *target = dictionary.insert(term.first);
+                delete target->posting; // a repeated term line replaces the older one
+                target->posting = term.second;
+                if (budget && !budget->charge((dictionary.table_count() - tables) * sizeof(HashTable)))
+                {
+                    // The linked postings go with the dictionary, the rest are freed here
+                    discard(parsed, c, t + 1);
+                    dictionary.deleteTrie();
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    // Shared by all the parsing threads of one load
+    struct Limits
+    {
+        MemoryBudget *budget;
+        bool with_positions;
+        std::atomic<bool> failed{false};
+    };
+
+    // Deletes the postings from term t of chunk c onwards, which were never linked
+    static void discard(std::vector<Parsed> &parsed, size_t c, size_t t)
+    {
+        for (; c < parsed.size(); c++, t = 0)
+        {
+            for (; t < parsed[c].size(); t++)
+                delete parsed[c][t].second;
+        }
+    }
+
+    static bool is_space(const char &c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    // Reads the next unsigned number; returns false at the end of the line
+    static bool number(const char *&it, const char *line_end, unsigned &value)
+    {
+        while (it < line_end && is_space(*it))
+            it++;
+        auto result = std::from_chars(it, line_end, value);
+        if (result.ec != std::errc())
+            return false;
+        it = result.ptr;
+        return true;
+    }
+
+    // Parses "term doc_count (ID term_freq pos*)*" lines in [it, end)
+    static void parse(const char *it, const char *end, Parsed &out, Limits &limits)
+    {
+        while (it < end && !limits.failed.load(std::memory_order_relaxed))
+        {
+            const char *line_end = it;
+            while (line_end < end && *line_end != '\n')
+                line_end++;
+
+            while (it < line_end && is_space(*it))
+                it++;
+            const char *word = it;
+            while (it < line_end && !is_space(*it))
+                it++;
+            const std::string term(word, it);
+
+            unsigned doc_count, doc_ID, term_freq, pos;
+            if (!term.empty() && number(it, line_end, doc_count))
+            {
+                Posting *posting = new Posting;
+                for (unsigned i = 0; i < doc_count; i++)
+                {
+                    if (!number(it, line_end, doc_ID) || !number(it, line_end, term_freq))
+                        break;
+                    if (limits.budget
+                        && !limits.budget->charge((i == 0 ? sizeof(Posting) : 0) + sizeof(Node<Document>)
+                                                  + (limits.with_positions ? term_freq * sizeof(Node<unsigned>) : 0)))
+                    {
+                        limits.failed = true;
+                        break;
+                    }
+                    if (!limits.with_positions)
+                        posting->push_document(doc_ID, term_freq, 0);
+
+                    for (unsigned j = 0; j < term_freq; j++)
+                    {
+                        if (!number(it, line_end, pos))
+                            break;
+                        if (limits.with_positions)
+                            posting->push_directly(doc_ID, pos);
+                    }
+                }
+                if (posting->doc_count)
+                    out.emplace_back(term, posting);
+                else
+                    delete posting;
+            }
+            it = line_end + 1;
+        }
+    }
+};
+
+#endif
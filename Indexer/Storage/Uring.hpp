@@ -0,0 +1,177 @@
+#pragma once
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// A bare io_uring: one submission and one completion ring shared with the kernel
+// Talks to the kernel through the raw syscalls, so liburing is not needed
+// Only one thread may use a Uring
+class Uring
+{
+public:
+    // ok() is false if the kernel has no io_uring (or it is disabled)
+    Uring(const unsigned &entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+            return;
+
+        sq_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            sq_bytes = cq_bytes = sq_bytes > cq_bytes ? sq_bytes : cq_bytes;
+
+        sq_ring = map(sq_bytes, IORING_OFF_SQ_RING);
+        cq_ring = single ? sq_ring : map(cq_bytes, IORING_OFF_CQ_RING);
+        sqe_bytes = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(map(sqe_bytes, IORING_OFF_SQES));
+        if (!sq_ring || !cq_ring || !sqes)
+        {
+            release();
+            return;
+        }
+
+        char *sq = static_cast<char *>(sq_ring);
+        char *cq = static_cast<char *>(cq_ring);
+        sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        sq_entries = params.sq_entries;
+        local_tail = *sq_tail;
+    }
+
+    Uring(const Uring &) = delete;
+    Uring &operator=(const Uring &) = delete;
+
+    ~Uring()
+    {
+        release();
+    }
+
+    bool ok() const
+    {
+        return fd >= 0;
+    }
+
+    // Whether the kernel can carry out an opcode; io_uring came before most of its
+    // opcodes (OPENAT, READ and CLOSE need 5.6), and a kernel too old to be asked
+    // (before 5.6) supports none of those
+    bool supports(const unsigned char &opcode) const
+    {
+        const unsigned ops = 256;
+        alignas(io_uring_probe) char buffer[sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op)];
+        memset(buffer, 0, sizeof(buffer));
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(buffer);
+        if (fd < 0 || syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, ops) < 0)
+            return false;
+        return opcode <= probe->last_op && opcode < probe->ops_len &&
+               (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    // A zeroed entry to fill in, or nullptr if the submission ring is full
+    io_uring_sqe *get_sqe()
+    {
+        const unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if (local_tail - head >= sq_entries)
+            return nullptr;
+        const unsigned index = local_tail & sq_mask;
+        io_uring_sqe *sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        local_tail++;
+        queued++;
+        return sqe;
+    }
+
+    // Hands every new entry to the kernel and waits until wait_for of them completed
+    // Returns false on error
+    bool submit(const unsigned &wait_for = 0)
+    {
+        __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+        const int submitted = syscall(__NR_io_uring_enter, fd, queued, wait_for,
+                                      wait_for ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+        if (submitted < 0)
+            return false;
+        queued -= submitted;
+        return true;
+    }
+
+    // Waits until count entries the kernel has taken completed, submitting nothing more
+    // Returns false on error
+    bool wait(const unsigned &count)
+    {
+        return syscall(__NR_io_uring_enter, fd, 0, count, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0;
+    }
+
+    // Entries from get_sqe() the kernel has not taken yet
+    unsigned unsubmitted() const
+    {
+        return queued;
+    }
+
+    // Calls visit(user_data, result) for every completion so far; returns how many
+    template <typename Visitor>
+    unsigned for_each_completion(Visitor visit)
+    {
+        unsigned head = *cq_head;
+        const unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned seen = 0;
+        for (; head != tail; head++, seen++)
+        {
+            const io_uring_cqe &cqe = cqes[head & cq_mask];
+            visit(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return seen;
+    }
+
+private:
+    int fd{-1};
+    void *sq_ring{0};
+    void *cq_ring{0};
+    io_uring_sqe *sqes{0};
+    size_t sq_bytes{0}, cq_bytes{0}, sqe_bytes{0};
+
+    unsigned *sq_head{0}, *sq_tail{0}, *sq_array{0};
+    unsigned *cq_head{0}, *cq_tail{0};
+    unsigned sq_mask{0}, cq_mask{0}, sq_entries{0};
+    io_uring_cqe *cqes{0};
+    unsigned local_tail{0}; // entries handed out by get_sqe()
+    unsigned queued{0};     // entries not yet taken by the kernel
+
+    void *map(const size_t &bytes, const off_t &offset)
+    {
+        void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    void release()
+    {
+        if (sqes)
+            munmap(sqes, sqe_bytes);
+        if (cq_ring && cq_ring != sq_ring)
+            munmap(cq_ring, cq_bytes);
+        if (sq_ring)
+            munmap(sq_ring, sq_bytes);
+        if (fd >= 0)
+            close(fd);
+        sqes = nullptr;
+        sq_ring = cq_ring = nullptr;
+        fd = -1;
+    }
+};
+
+#endif
@@ -0,0 +1,194 @@
+#pragma once
+#ifndef BLOOM_FILTER_HPP
+#define BLOOM_FILTER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// A blocked Bloom filter of terms: says a term is surely not in the dictionary,
+// or that it may be, in which case the trie has to be searched
+// Every term sets all its bits in one 64-byte block, so a lookup touches a single
+// cache line however many bits it tests, where a trie walk chases a pointer per letter
+// Terms may be added while other threads look terms up (one thread adds at a time)
+class BloomFilter
+{
+public:
+    BloomFilter() = default;
+    BloomFilter(const BloomFilter &) = delete;
+    BloomFilter &operator=(const BloomFilter &) = delete;
+
+    BloomFilter(BloomFilter &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    BloomFilter &operator=(BloomFilter &&other) noexcept
+    {
+        std::swap(blocks, other.blocks);
+        std::swap(block_count, other.block_count);
+        std::swap(hashes, other.hashes);
+        std::swap(added, other.added);
+        std::swap(sized_for, other.sized_for);
+        std::swap(target_rate, other.target_rate);
+        return *this;
+    }
+
+    // Sized for keys terms, of which about false_positive_rate of those not added pass
+    // Blocking costs some accuracy, made up for with a few more bits per term
+    BloomFilter(const unsigned long long &keys, const double &false_positive_rate)
+    {
+        const double rate = std::min(0.5, std::max(1e-6, false_positive_rate));
+        const double bits_per_key = -std::log(rate) / (std::log(2.0) * std::log(2.0)) * 1.2;
+        block_count = std::max<unsigned long long>(1, std::ceil(std::max<unsigned long long>(keys, 1) * bits_per_key / 512));
+        hashes = std::min(16u, std::max(1u, unsigned(std::lround(bits_per_key / 1.2 * std::log(2.0)))));
+        blocks.reset(new Block[block_count]);
+        sized_for = std::max<unsigned long long>(keys, 1);
+        target_rate = rate;
+    }
+
+    bool empty() const { return block_count == 0; }
+    unsigned long long keys() const { return added; }
+    // Past this many keys the false positive rate climbs above rate()
+    unsigned long long capacity() const { return sized_for; }
+    double rate() const { return target_rate; }
+    size_t bytes() const { return block_count * sizeof(Block); }
+
+    void clear()
+    {
+        blocks.reset();
+        block_count = 0;
+        added = 0;
+        sized_for = 0;
+        target_rate = 0;
+    }
+
+    void add(const std::string_view &key)
+    {
+        uint64_t h = hash(key);
+        Block &block = blocks[pick(h)];
+        for (unsigned i = 0; i < hashes; i++, h += h >> 32 | 1)
+            block.words[h >> 6 & 7].fetch_or(uint64_t(1) << (h & 63), std::memory_order_relaxed);
+        added++;
+    }
+
+    // False only if key was never added; always true while the filter is empty
+    bool may_contain(const std::string_view &key) const
+    {
+        return may_contain_hash(hash(key));
+    }
+
+    // may_contain() split in two, for callers that interleave lookups: prefetch()
+    // the block of hash(key), do other work, then test with may_contain_hash()
+    void prefetch(const uint64_t &h) const
+    {
+        if (block_count)
+            __builtin_prefetch(&blocks[pick(h)]);
+    }
+
+    bool may_contain_hash(uint64_t h) const
+    {
+        if (!block_count)
+            return true;
+        const Block &block = blocks[pick(h)];
+        for (unsigned i = 0; i < hashes; i++, h += h >> 32 | 1)
+        {
+            if (!(block.words[h >> 6 & 7].load(std::memory_order_relaxed) >> (h & 63) & 1))
+                return false;
+        }
+        return true;
+    }
+
+    // "BLM1", the number of hashes, blocks and keys, then the blocks
+    void write(std::ostream &out) const
+    {
+        out.write("BLM1", 4);
+        out.write(reinterpret_cast<const char *>(&hashes), sizeof(hashes));
+        out.write(reinterpret_cast<const char *>(&block_count), sizeof(block_count));
+        out.write(reinterpret_cast<const char *>(&added), sizeof(added));
+        for (unsigned long long b = 0; b < block_count; b++)
+        {
+            for (const auto &word : blocks[b].words)
+            {
+                const uint64_t bits = word.load(std::memory_order_relaxed);
+                out.write(reinterpret_cast<const char *>(&bits), sizeof(bits));
+            }
+        }
+    }
+
+    // Returns false (and leaves the filter empty) if the stream does not hold a whole filter
+    bool read(std::istream &in)
+    {
+        clear();
+        char magic[4];
+        unsigned count_hashes;
+        unsigned long long count_blocks, count_keys;
+        if (!in.read(magic, 4) || std::memcmp(magic, "BLM1", 4) != 0 ||
+            !in.read(reinterpret_cast<char *>(&count_hashes), sizeof(count_hashes)) ||
+            !in.read(reinterpret_cast<char *>(&count_blocks), sizeof(count_blocks)) ||
+            !in.read(reinterpret_cast<char *>(&count_keys), sizeof(count_keys)) ||
+            count_hashes == 0 || count_hashes > 16 || count_blocks == 0)
+            return false;
+        std::unique_ptr<Block[]> read_blocks(new Block[count_blocks]);
+        for (unsigned long long b = 0; b < count_blocks; b++)
+        {
+            for (auto &word : read_blocks[b].words)
+            {
+                uint64_t bits;
+                if (!in.read(reinterpret_cast<char *>(&bits), sizeof(bits)))
+                    return false;
+                word.store(bits, std::memory_order_relaxed);
+            }
+        }
+        blocks = std::move(read_blocks);
+        block_count = count_blocks;
+        hashes = count_hashes;
+        added = count_keys;
+        // The file does not say what the filter was sized for: taken as full, at the
+        // rate its number of hashes is best for
+        sized_for = std::max<unsigned long long>(count_keys, 1);
+        target_rate = std::pow(0.5, count_hashes);
+        return true;
+    }
+
+    // FNV-1a, then mixed so that every bit depends on every character
+    static uint64_t hash(const std::string_view &key)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (const char &c : key)
+            h = (h ^ (unsigned char)c) * 1099511628211ull;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ h >> 33;
+    }
+
+private:
+    struct alignas(64) Block
+    {
+        std::atomic<uint64_t> words[8]{};
+    };
+
+    std::unique_ptr<Block[]> blocks;
+    unsigned long long block_count{0};
+    unsigned hashes{0};
+    unsigned long long added{0};
+    unsigned long long sized_for{0};
+    double target_rate{0};
+
+    // The block, from the high half of the hash; the bits come from the low half
+    unsigned long long pick(const uint64_t &h) const
+    {
+        return (h >> 32) * block_count >> 32;
+    }
+};
+
+#endif
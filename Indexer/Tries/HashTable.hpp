@@ -34,16 +34,32 @@ public:
     // Insert a character into the hash table
     HashEntry *insert(const char &symbol)
     {
-        HashEntry* entry; 
-        if (symbol >= 'a' && symbol <= 'z')
-            entry = &entries[symbol - 97];
-        else
-            entry = &entries[symbol - 22];
+        const BYTE index = (symbol >= 'a' && symbol <= 'z') ? symbol - 97 : symbol - 22;
+        HashEntry* entry = &entries[index];
         entry->data = symbol;
-        entry->empty = false;
+        publish(entry->empty, false);
+        publish(used, used | (1ull << index));
         return entry;
     }
 
+    // Bit i is set if entries[i] is in use; lets a walk skip empty entries without reading them
+    unsigned long long in_use() const
+    {
+        return observe(used);
+    }
+
+    // The character stored at position i
+    static char symbol_at(const BYTE &i)
+    {
+        return i < 26 ? 'a' + i : '0' + (i - 26);
+    }
+
+    // The position of a character
+    static BYTE index_of(const char &symbol)
+    {
+        return (symbol >= 'a' && symbol <= 'z') ? symbol - 97 : symbol - 22;
+    }
+
     // Search for a character in the hash table
     HashEntry *search(const char &symbol)
     {
@@ -52,12 +68,13 @@ public:
             entry = &entries[symbol - 97];
         else
             entry = &entries[symbol - 22];
-        if (entry->empty)
+        if (observe(entry->empty))
             return nullptr;
         return entry;
     }
 
 private:
+    unsigned long long used{0};
     HashEntry entries[size];
 };
 
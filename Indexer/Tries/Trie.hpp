@@ -1,19 +1,39 @@
 #pragma once
 #ifndef TRIE_HPP
 #define TRIE_HPP
-#define TOTAL_DOCS (30)
 
 #include "HashTable.hpp"
+#include "BloomFilter.hpp"
+#include <algorithm>
+#include <memory>
 #include <queue>
+#include <string>
+#include <string_view>
 #include <vector>
 #include <ostream>
-#include <numeric>
 
 class Trie
 {
 public:
     using Results = std::vector<std::pair<std::string, Posting *>>;
 
+    // A term found by fuzzy(); closer terms come first, then terms in more docs
+    struct Match
+    {
+        std::string term;
+        unsigned distance{0}; // edits (insert, delete or replace a character) from the word
+        unsigned doc_count{0};
+
+        bool operator<(const Match &other) const
+        {
+            if (distance != other.distance)
+                return distance < other.distance;
+            if (doc_count != other.doc_count)
+                return doc_count > other.doc_count;
+            return term < other.term;
+        }
+    };
+
     // Constructor and deconstructor
     Trie()
     {
@@ -26,24 +46,14 @@ public:
     }
     void deleteTrie();
     HashEntry *search(const std::string& prefix);
-
-    std::vector<unsigned> AND(const std::string& s1, const std::string& s2);
-    std::vector<unsigned> OR(const std::string& s1, const std::string& s2);
-    std::vector<unsigned> NOT(const std::string& s);
-
-    // Overloaded functions in case a list of docs is provided
-    std::vector<unsigned> AND(const std::string& s, const std::vector<unsigned> v);
-    std::vector<unsigned> OR(const std::string& s, const std::vector<unsigned> v);
-    std::vector<unsigned> NOT(const std::vector<unsigned> v);
-
-    // Overloaded functions in case 2 lists of docs are provided
-    std::vector<unsigned> AND(std::vector<unsigned> v1, std::vector<unsigned> v2);
-    std::vector<unsigned> OR(std::vector<unsigned> v1, std::vector<unsigned> v2);
+    void search_many(const std::string_view *terms, const size_t &count, HashEntry **found);
+    std::vector<HashEntry *> search_many(const std::vector<std::string> &terms);
+    std::vector<Match> fuzzy(const std::string& word, const unsigned& max_distance, const size_t& limit = 10);
 
     HashEntry *insert(std::string& prefix)
     {
         HashTable *ptr = root;
-        HashEntry *target;
+        HashEntry *target = nullptr; // stays null for an empty string
         const auto &length = prefix.length();
 
         for (unsigned i = 0; i < length; i++)
@@ -55,12 +65,26 @@ public:
 
             if (i == length - 1)
             {
-                target->endOfWord = true;
+                if (!target->endOfWord)
+                {
+                    // in the filter before any reader can find it in the trie
+                    terms++;
+                    if (filter)
+                    {
+                        if (terms > filter->capacity())
+                            grow_filter();
+                        filter->add(prefix);
+                    }
+                    publish(target->endOfWord, true);
+                }
                 break;
             }
-            // move on to next table
+            // move on to next table; it is linked in only once it is ready for readers
             if (target->next_table == nullptr)
-                target->next_table = new HashTable;
+            {
+                publish(target->next_table, new HashTable);
+                tables++;
+            }
             ptr = target->next_table;
         }
         return target;
@@ -72,15 +96,168 @@ public:
         writeUtil(root, prefix, buffer);
     }
 
+    // Writes doc-level postings and positions to two separate streams
+    // The postings stream refers to positions by their offset in the positions stream
+    void write_split(std::ostream &postings, std::ostream &positions);
+
+    // Calls visit(term, posting) for every term in alphabetical order
+    template <typename Visitor>
+    void for_each(Visitor visit)
+    {
+        std::string prefix;
+        for_eachUtil(root, prefix, visit);
+    }
+
+    // Calls visit(table, depth) for every hash table; the root is at depth 0
+    template <typename Visitor>
+    void for_each_table(Visitor visit)
+    {
+        std::queue<std::pair<HashTable *, unsigned>> q;
+        q.push(std::make_pair(root, 0u));
+
+        while (!q.empty())
+        {
+            auto f = q.front();
+            q.pop();
+            visit(f.first, f.second);
+
+            for (HashEntry &beg : f.first->entries)
+            {
+                if (beg.next_table)
+                    q.push(std::make_pair(beg.next_table, f.second + 1));
+            }
+        }
+    }
+
+    // Number of terms
+    unsigned long long term_count() const
+    {
+        return terms;
+    }
+
+    // Puts a Bloom filter of every term in front of search(), so most terms that are
+    // not in the dictionary are turned away without walking the trie (see BloomFilter.hpp)
+    // Terms inserted later are added to it, and once there are more than it was sized
+    // for it is rebuilt for twice as many, so it keeps to its false positive rate
+    // Not safe while other threads search
+    void build_filter(const double &false_positive_rate)
+    {
+        std::unique_ptr<BloomFilter> built(new BloomFilter(std::max<unsigned long long>(terms, 1), false_positive_rate));
+        std::string prefix;
+        add_terms(root, prefix, *built);
+        filters.clear();
+        filter = built.get();
+        filters.push_back(std::move(built));
+    }
+
+    // Uses a filter written by write_filter(); returns false (and keeps no filter) if the
+    // stream holds none or it was built for a dictionary with another number of terms
+    bool read_filter(std::istream &in)
+    {
+        std::unique_ptr<BloomFilter> read(new BloomFilter);
+        filters.clear();
+        filter = nullptr;
+        if (!read->read(in) || read->keys() != terms)
+            return false;
+        filter = read.get();
+        filters.push_back(std::move(read));
+        return true;
+    }
+
+    void write_filter(std::ostream &out) const
+    {
+        get_filter().write(out);
+    }
+
+    // The filter searches use now (an empty one if there is none)
+    const BloomFilter &get_filter() const
+    {
+        const static BloomFilter none;
+        const BloomFilter *current = observe(filter);
+        return current ? *current : none;
+    }
+
+    // Bytes of the filter and of those it outgrew, which readers may still hold
+    size_t filter_bytes() const
+    {
+        size_t total = 0;
+        for (const auto &f : filters)
+            total += f->bytes();
+        return total;
+    }
+
+    // Number of hash tables currently allocated (including the root)
+    unsigned long long table_count() const
+    {
+        return tables;
+    }
+
 private:
     HashTable *root{0};
+    unsigned long long tables{1};
+    unsigned long long terms{0};
+    BloomFilter *filter{0}; // null unless build_filter() or read_filter() made one
+    std::vector<std::unique_ptr<BloomFilter>> filters; // filters.back() is filter; the ones it
+                                                       // replaced live until the next build or clear
     void writeUtil(HashTable *ptr, std::string &prefix, std::ostream &buffer);
+    void fuzzyUtil(HashTable *ptr, const std::string &word, const unsigned &max_distance, const unsigned *above,
+                   std::string &prefix, std::vector<unsigned> &rows, std::vector<Match> &matches);
+
+    // A bigger filter replaces the one that is full; readers that still hold the old
+    // one keep using it, so it is not freed yet
+    void grow_filter()
+    {
+        std::unique_ptr<BloomFilter> bigger(new BloomFilter(2 * terms, filter->rate()));
+        std::string prefix;
+        add_terms(root, prefix, *bigger);
+        publish(filter, bigger.get());
+        filters.push_back(std::move(bigger));
+    }
+
+    // Adds every term, with a posting yet or not, to a filter
+    void add_terms(HashTable *ptr, std::string &prefix, BloomFilter &to)
+    {
+        for (HashEntry &beg : ptr->entries)
+        {
+            if (beg.empty == true)
+                continue;
+
+            prefix.push_back(beg.data);
+            if (beg.endOfWord)
+                to.add(prefix);
+            if (beg.next_table)
+                add_terms(beg.next_table, prefix, to);
+            prefix.pop_back();
+        }
+    }
+
+    template <typename Visitor>
+    void for_eachUtil(HashTable *ptr, std::string &prefix, Visitor &visit)
+    {
+        for (HashEntry &beg : ptr->entries)
+        {
+            if (beg.empty == true)
+                continue;
+
+            prefix.push_back(beg.data);
+            if (beg.endOfWord && beg.posting)
+                visit(prefix, beg.posting);
+            if (beg.next_table)
+                for_eachUtil(beg.next_table, prefix, visit);
+            prefix.pop_back();
+        }
+    }
 };
 
 // finds the given std::string
 // returns nullptr if not found
+// safe to call while one thread inserts (see Extensions/Publish.hpp); the
+// entry's posting must then be read with observe(entry->posting)
 HashEntry *Trie::search(const std::string &prefix)
 {
+    const BloomFilter *current = observe(filter);
+    if (current && !current->may_contain(prefix))
+        return nullptr;
     HashTable *ptr = root;
     HashEntry *target;
     const auto &length = prefix.length();
@@ -94,366 +271,273 @@ HashEntry *Trie::search(const std::string &prefix)
 
         if (i == length - 1)
         {
-            if (target->endOfWord == true)
+            if (observe(target->endOfWord) == true)
                 return target;
             break;
         }
         // move on to next table
-        ptr = target->next_table;
+        ptr = observe(target->next_table);
         if (ptr == nullptr) // if next table does not exist
             break;
     }
     return nullptr;
 }
 
-// Writes trie to file
-void Trie::writeUtil(HashTable *ptr, std::string &prefix, std::ostream &buffer)
+// finds terms[i] for every i < count, as search() would, into found[i]
+// A walk waits on a cache miss at every letter, as the next table is only known once
+// the entry before it is read; here up to search_group walks take turns instead
+// (asynchronous memory access chaining): each one reads the entry prefetched for it,
+// prefetches where it goes next and makes way for the others, so the misses of many
+// terms overlap instead of adding up. A finished walk hands its place to the next term
+// safe to call while one thread inserts, like search()
+void Trie::search_many(const std::string_view *terms, const size_t &count, HashEntry **found)
 {
-    for (HashEntry &beg : ptr->entries)
+    const static unsigned search_group = 16;
+    struct Walk
     {
-        if (beg.empty == true)
-            continue;
-
-        prefix.push_back(beg.data);
-        if (beg.endOfWord)
+        size_t term;
+        unsigned depth;   // the letter to look up next
+        HashTable *table; // where it is; null while the filter has yet to be read
+        uint64_t hash;
+    };
+    Walk walks[search_group];
+    const BloomFilter &current = get_filter();
+    unsigned active = 0;
+    size_t next = 0;
+
+    // Starts the next term in walks[w] with its filter block fetched; false if none is left
+    auto start = [&](const unsigned &w) {
+        while (next < count)
         {
-            buffer << prefix
-                   << " "
-                   << beg.posting->doc_count
-                   << " ";
+            const size_t t = next++;
+            found[t] = nullptr;
+            if (terms[t].empty())
+                continue;
+            walks[w] = Walk{t, 0, nullptr, BloomFilter::hash(terms[t])};
+            current.prefetch(walks[w].hash);
+            return true;
+        }
+        return false;
+    };
+    while (active < search_group && start(active))
+        active++;
 
-            for (auto doc = beg.posting->documents.begin(); doc != nullptr; doc = doc->next)
+    while (active)
+    {
+        for (unsigned w = 0; w < active;)
+        {
+            Walk &walk = walks[w];
+            const std::string_view &term = terms[walk.term];
+            bool done = false;
+            if (!walk.table)
             {
-                buffer << doc->data.ID
-                       << " "
-                       << doc->data.term_freq;
-
-                for (auto pos = doc->data.positions.begin(); pos != nullptr; pos = pos->next)
-                    buffer << " "
-                           << pos->data;
-                buffer << " ";
+                done = !current.may_contain_hash(walk.hash);
+                walk.table = root;
             }
-            buffer << "\n";
-
-            if (!beg.next_table)
+            else
             {
-                prefix.pop_back();
-                continue;
+                HashEntry *target = walk.table->search(term[walk.depth]);
+                if (target == nullptr)
+                    done = true;
+                else if (walk.depth == term.length() - 1)
+                {
+                    if (observe(target->endOfWord) == true)
+                        found[walk.term] = target;
+                    done = true;
+                }
+                else
+                {
+                    walk.table = observe(target->next_table);
+                    walk.depth++;
+                    done = walk.table == nullptr;
+                }
             }
-        }
-        if (beg.next_table)
-        {
-            writeUtil(beg.next_table, prefix, buffer);
-            prefix.pop_back();
+            if (!done)
+            {
+                __builtin_prefetch(&walk.table->entries[HashTable::index_of(term[walk.depth])]);
+                w++;
+            }
+            else if (start(w))
+                w++;
+            else
+                walk = walks[--active]; // the last walk takes this place and has its turn now
         }
     }
 }
 
-std::vector<unsigned> Trie::AND(const std::string& s1, const std::string& s2)
+std::vector<HashEntry *> Trie::search_many(const std::vector<std::string> &terms)
 {
-    std::vector<unsigned> results;
-
-    HashEntry* h1 = search(s1);
-    if (h1 == nullptr)
-        return results;
-    HashEntry* h2 = search(s2);
-    if (h2 == nullptr)
-        return results;
-
-    auto p1 = h1->posting->documents.begin();
-    auto p2 = h2->posting->documents.begin();
-
-    while (p1 && p2)
-    {
-        if (p1->data.ID == p2->data.ID)
-        {
-            results.push_back(p1->data.ID);
-            p1 = p1->next;
-            p2 = p2->next;
-        }
-        else if (p1->data.ID < p2->data.ID)
-            p1 = p1->next;
-        else
-            p2 = p2->next;
-    }
-    return results;
+    std::vector<std::string_view> views(terms.begin(), terms.end());
+    std::vector<HashEntry *> found(terms.size());
+    search_many(views.data(), views.size(), found.data());
+    return found;
 }
 
-std::vector<unsigned> Trie::AND(const std::string& s, const std::vector<unsigned> v)
+// finds the terms at most max_distance edits (Levenshtein distance) away from word
+// returns at most limit of them, closest first and then those in the most docs
+// Every table entry is one row of the edit distance table, for the prefix it ends;
+// a subtree is skipped as soon as no cell of its row is within max_distance, so only
+// prefixes close to the word are visited
+// The distance allowed grows one edit at a time until limit terms are found, as
+// farther terms could not make the list then; most typos are one edit, which
+// visits far fewer tables than two
+// safe to call while one thread inserts, like search()
+std::vector<Trie::Match> Trie::fuzzy(const std::string &word, const unsigned &max_distance, const size_t &limit)
 {
-    std::vector<unsigned> results;
-
-    if (v.empty())
-        return results;
-    HashEntry* h = search(s);
-    if (h == nullptr)
-        return results;
-
-    auto p1 = h->posting->documents.begin();
-    auto p2 = v.begin();
-
-    while (p1 && p2 != v.end())
+    std::vector<Match> matches;
+    const size_t width = word.length() + 1;
+    // One row per entry of a table on every level; a prefix longer than the word
+    // by more than max_distance can never match, so that many levels are enough
+    std::vector<unsigned> rows((word.length() + max_distance + 1) * HashTable::size * width);
+    std::vector<unsigned> empty_prefix(width);
+    for (size_t j = 0; j < width; j++)
+        empty_prefix[j] = j;
+    std::string prefix;
+    for (unsigned distance = 0; distance <= max_distance && matches.size() < limit; distance++)
     {
-        if (p1->data.ID == *p2)
-        {
-            results.push_back(p1->data.ID);
-            p1 = p1->next;
-            p2++;
-        }
-        else if (p1->data.ID < *p2)
-            p1 = p1->next;
-        else
-            p2++;
+        matches.clear();
+        fuzzyUtil(root, word, distance, empty_prefix.data(), prefix, rows, matches);
     }
-    return results;
-}
-
-std::vector<unsigned> Trie::AND(const std::vector<unsigned> v1, const std::vector<unsigned> v2)
-{
-    std::vector<unsigned> results;
-
-    if (v1.empty() || v2.empty())
-        return results;
-
-    auto p1 = v1.begin();
-    auto p2 = v2.begin();
 
-    while (p1 != v1.end() && p2 != v2.end())
-    {
-        if (*p1 == *p2)
-        {
-            results.push_back(*p1);
-            p1++;
-            p2++;
-        }
-        else if (*p1 < *p2)
-            p1++;
-        else
-            p2++;
-    }
-    return results;
+    const size_t keep = std::min(limit, matches.size());
+    std::partial_sort(matches.begin(), matches.begin() + keep, matches.end());
+    matches.resize(keep);
+    return matches;
 }
 
-std::vector<unsigned> Trie::OR(const std::string& s1, const std::string& s2)
+void Trie::fuzzyUtil(HashTable *ptr, const std::string &word, const unsigned &max_distance, const unsigned *above,
+                     std::string &prefix, std::vector<unsigned> &rows, std::vector<Match> &matches)
 {
-    std::vector<unsigned> results;
-
-    HashEntry* h1 = search(s1);
-    HashEntry* h2 = search(s2);
-    
-    if (h1 == nullptr && h2 == nullptr)
-        return results;
-    if (h1 == nullptr)
+    const size_t width = word.length() + 1;
+    const size_t depth = prefix.length() + 1;
+    unsigned *level = &rows[prefix.length() * HashTable::size * width];
+
+    // Only cells within max_distance of the diagonal can be within max_distance;
+    // the cells just outside this band get max_distance + 1 for the next row to read
+    const size_t lo = depth > max_distance + 1 ? depth - max_distance : 1;
+    const size_t hi = std::min(width - 1, depth + max_distance);
+
+    // First the rows of the entries in use, which need only their characters; then the
+    // close entries are read, and the tables below them fetched so that they load while
+    // the earlier ones are searched
+    BYTE close[HashTable::size];
+    BYTE count = 0;
+    for (unsigned long long used = ptr->in_use(); used; used &= used - 1)
     {
-        auto it = h2->posting->documents.begin();
-        while (it != h2->posting->documents.last())
+        const BYTE i = __builtin_ctzll(used);
+        const char symbol = HashTable::symbol_at(i);
+        unsigned *row = level + i * width;
+        row[0] = depth;
+        if (lo > 1)
+            row[lo - 1] = max_distance + 1;
+        if (hi + 1 < width)
+            row[hi + 1] = max_distance + 1;
+        unsigned lowest = lo == 1 ? row[0] : max_distance + 1;
+        for (size_t j = lo; j <= hi; j++)
         {
-            results.push_back((*it).data.ID);
-            it = it->next;
+            row[j] = std::min(std::min(above[j], row[j - 1]) + 1, above[j - 1] + (word[j - 1] != symbol));
+            lowest = std::min(lowest, row[j]);
         }
-        return results;
+        if (lowest > max_distance)
+            continue;
+
+        close[count++] = i;
+        __builtin_prefetch(&ptr->entries[i]);
     }
-    if (h2 == nullptr)
+    for (BYTE k = 0; k < count; k++)
     {
-        auto it = h1->posting->documents.begin();
-        while (it != h1->posting->documents.last())
-        {
-            results.push_back((*it).data.ID);
-            it = it->next;
-        }
-        return results;
+        HashTable *next = observe(ptr->entries[close[k]].next_table);
+        if (next)
+            __builtin_prefetch(next); // where in_use() is
     }
 
-    auto p1 = h1->posting->documents.begin();
-    auto p2 = h2->posting->documents.begin();
-
-    while (p1 || p2)
+    for (BYTE k = 0; k < count; k++)
     {
-        if (!p1)
-        {
-            auto it = p2;
-            while (it)
-            {
-                results.push_back(it->data.ID);
-                it = it->next;
-            }
-            break;
-        }
-        if (!p2)
-        {
-            auto it = p1;
-            while (it)
-            {
-                results.push_back(it->data.ID);
-                it = it->next;
-            }
-            break;
-        }
-        if (p1->data.ID == p2->data.ID)
-        {
-            results.push_back(p1->data.ID);
-            p1 = p1->next;
-            p2 = p2->next;
-        }
-        else if (p1->data.ID < p2->data.ID)
-        {
-            results.push_back(p1->data.ID);
-            p1 = p1->next;
-        }
-        else
-        {
-            results.push_back(p2->data.ID);
-            p2 = p2->next;
-        }
+        HashEntry &beg = ptr->entries[close[k]];
+        const unsigned *row = level + close[k] * width;
+        prefix.push_back(beg.data);
+        const Posting *posting = observe(beg.endOfWord) ? observe(beg.posting) : nullptr;
+        if (hi == width - 1 && row[hi] <= max_distance && posting && observe(posting->doc_count))
+            matches.push_back(Match{prefix, row[hi], observe(posting->doc_count)});
+        HashTable *next = observe(beg.next_table);
+        if (next)
+            fuzzyUtil(next, word, max_distance, row, prefix, rows, matches);
+        prefix.pop_back();
     }
-    return results;
 }
 
-std::vector<unsigned> Trie::OR(const std::string& s, const std::vector<unsigned> v)
+// Writes trie to file
+void Trie::writeUtil(HashTable *ptr, std::string &prefix, std::ostream &buffer)
 {
-    std::vector<unsigned> results;
-    HashEntry* h = search(s);
-    
-    if (h == nullptr && v.empty())
-        return results;
-    if (h == nullptr)
-        return v;
-    if (v.empty())
+    for (HashEntry &beg : ptr->entries)
     {
-        auto it = h->posting->documents.begin();
-        while (it != h->posting->documents.last())
+        if (beg.empty == true)
+            continue;
+
+        prefix.push_back(beg.data);
+        if (beg.endOfWord)
         {
-            results.push_back(it->data.ID);
-            it = it->next;
-        }
-        return results;
-    }
+            buffer << prefix
+                   << " "
+                   << beg.posting->doc_count
+                   << " ";
 
-    auto p1 = h->posting->documents.begin();
-    auto p2 = v.begin();
+            for (auto doc = beg.posting->documents.begin(); doc != nullptr; doc = doc->next)
+            {
+                buffer << doc->data.ID
+                       << " "
+                       << doc->data.term_freq;
 
-    while (p1 || p2 != v.end())
-    {
-        if (!p1)
-        {
-            results.insert(results.end(), p2, v.end());
-            break;
-        }
-        if (p2 == v.end())
-        {
-            auto it = p1;
-            while (it)
+                for (auto pos = doc->data.positions.begin(); pos != nullptr; pos = pos->next)
+                    buffer << " "
+                           << pos->data;
+                buffer << " ";
+            }
+            buffer << "\n";
+
+            if (!beg.next_table)
             {
-                results.push_back(it->data.ID);
-                it = it->next;
+                prefix.pop_back();
+                continue;
             }
-            break;
         }
-        if (p1->data.ID == *p2)
-        {
-            results.push_back(p1->data.ID);
-            p1 = p1->next;
-            p2++;
-        }
-        else if (p1->data.ID < *p2)
-        {
-            results.push_back(p1->data.ID);
-            p1 = p1->next;
-        }
-        else
+        if (beg.next_table)
         {
-            results.push_back(*p2);
-            p2++;
+            writeUtil(beg.next_table, prefix, buffer);
+            prefix.pop_back();
         }
     }
-    return results;
 }
 
-std::vector<unsigned> Trie::OR(const std::vector<unsigned> v1, const std::vector<unsigned> v2)
+// Writes "term doc_count offset (ID term_freq)*" lines to postings
+// and the raw positions of every (term, doc) pair to positions
+// A term's positions are contiguous, so each doc's offset follows from the term_freqs before it
+void Trie::write_split(std::ostream &postings, std::ostream &positions)
 {
-    std::vector<unsigned> results;
-    
-    if (v1.empty() && v2.empty())
-        return results;
-    if (v1.empty())
-        return v2;
-    if (v2.empty())
-        return v1;
-
-    auto p1 = v1.begin();
-    auto p2 = v2.begin();
-
-    while (p1 != v1.end() || p2 != v2.end())
+    unsigned long long offset = 0; // counted in positions, not bytes
+
+    for_each([&](const std::string &term, Posting *posting)
     {
-        if (p1 == v1.end())
-        {
-            results.insert(results.end(), p2, v2.end());
-            break;
-        }
-        if (p2 == v2.end())
-        {
-            results.insert(results.end(), p1, v1.end());
-            break;
-        }
-        if (*p1 == *p2)
-        {
-            results.push_back(*p1);
-            p1++;
-            p2++;
-        }
-        else if (*p1 < *p2)
+        postings << term
+                 << " "
+                 << posting->doc_count
+                 << " "
+                 << offset
+                 << " ";
+
+        for (auto doc = posting->documents.begin(); doc != nullptr; doc = doc->next)
         {
-            results.push_back(*p1);
-            p1++;
+            postings << doc->data.ID
+                     << " "
+                     << doc->data.term_freq
+                     << " ";
+
+            for (auto pos = doc->data.positions.begin(); pos != nullptr; pos = pos->next)
+                positions.write(reinterpret_cast<const char *>(&pos->data), sizeof(unsigned));
+            offset += doc->data.term_freq;
         }
-        else
-        {
-            results.push_back(*p2);
-            p2++;
-        }
-    }
-    return results;
-}
-
-std::vector<unsigned> Trie::NOT(const std::string& s)
-{
-    std::vector<unsigned> results(TOTAL_DOCS);
-    iota(results.begin(), results.end(), 1); // vector contains all doc IDs
-
-    HashEntry* h = search(s);
-    if (h == nullptr)
-        return results;
-    
-    auto p = h->posting->documents.begin();
-    unsigned short j = 0;
-
-    while (p)
-    {
-        results.erase(results.begin() + p->data.ID - 1 - j);
-        j++;
-        p = p->next;
-    }
-    return results;
-}
-
-std::vector<unsigned> Trie::NOT(const std::vector<unsigned> v)
-{
-    std::vector<unsigned> results(TOTAL_DOCS);
-    iota(results.begin(), results.end(), 1); // vector contains all doc IDs
-
-    if (v.empty())
-        return results;
-    
-    auto p = v.begin();
-    unsigned short j = 0;
-
-    while (p != v.end())
-    {
-        results.erase(results.begin() + *p - 1 - j);
-        j++;
-        p++;
-    }
-    return results;
+        postings << "\n";
+    });
 }
 
 // Deletes the trie
@@ -472,10 +556,15 @@ void Trie::deleteTrie()
         {
             if (beg.next_table)
                 q.push(beg.next_table);
+            delete beg.posting;
         }
         delete f;
     }
     root = new HashTable;
+    tables = 1;
+    terms = 0;
+    filter = nullptr;
+    filters.clear();
 }
 
 #endif
\ No newline at end of file
@@ -1,186 +1,156 @@
 #include <iostream>
 #include <vector>
 #include "Indexer/Indexer.hpp"
+#include "Indexer/Query/Parser.hpp"
+#define PAGE_SIZE (20)
+#define SNIPPETS (10) // results shown with the text around the query's words
 using namespace std;
 
 // Proximity queries not implemented. SORRY!
 
-// Returns a number denoting operator precedence
-inline int precedence(string& op)
+// Usage: main [memory | explain [json] | count | exists | page | batch] [budget_bytes] [skip | disk]
+// "memory" prints how much memory the loaded index takes instead of asking for a query
+// "explain" runs the query and prints its plan with what every operator did
+// "count" and "exists" only print how many docs match or whether any does
+// "page" prints the results PAGE_SIZE at a time, evaluating only as many as are shown
+// "batch" reads a query per line until the input ends and answers them all together,
+// scanning a posting list that several of them use only once
+// budget_bytes makes loading fail if the index would take more than that;
+// with "skip" the index is loaded without positions instead, and with "disk" only its
+// dictionary is loaded and postings are read through a cache of what the budget leaves
+int main(int argc, char *argv[])
 {
-    if (op == "not")
-        return 2;
-    else if (op == "and")
-        return 1;
-    else if (op == "or")
-        return 0;
-    else
-        return -1;
-}
+    bool memory = argc > 1 && string(argv[1]) == "memory";
+    bool explain = argc > 1 && string(argv[1]) == "explain";
+    bool json = explain && argc > 2 && string(argv[2]) == "json";
+    bool count = argc > 1 && string(argv[1]) == "count";
+    bool exists = argc > 1 && string(argv[1]) == "exists";
+    bool page = argc > 1 && string(argv[1]) == "page";
+    bool batch = argc > 1 && string(argv[1]) == "batch";
+    int arg = memory || explain || count || exists || page || batch ? 2 + json : 1;
 
-// Ensures that for every opening bracket, there is a closing bracket too
-bool bracket_check(const string& s)
-{
-    vector<char> stack;
-    for (const char& i: s)
+    cout << "Reading index...\n" << endl;
+    Indexer indexer;
+    bool disk = arg + 1 < argc && string(argv[arg + 1]) == "disk";
+    if (arg < argc)
+        indexer.set_memory_budget(stoull(argv[arg]), arg + 1 < argc && string(argv[arg + 1]) == "skip"
+                                                         ? MemoryBudget::SKIP_POSITIONS
+                                                         : MemoryBudget::FAIL);
+    bool loaded;
+    if (disk)
+        loaded = indexer.read_blocks("terms.txt", "blocks.bin", "positions.bin");
+    else if (ifstream("postings.txt").good()) // boolean queries never need positions
+        loaded = indexer.read_split("postings.txt", "positions.bin");
+    else
+        loaded = indexer.read_parallel("index.txt");
+    if (!loaded)
     {
-        if (i == '(')
-            stack.push_back(i);
-        else if (i == ')')
-        {
-            if (!stack.size())
-                return false;
-            stack.pop_back();
-        }
+        cout << "The index does not fit in the memory budget!\n";
+        return 1;
     }
-    return stack.empty();
-}
+    if (indexer.skipped_positions())
+        cout << "Positions were skipped to stay within the memory budget.\n" << endl;
+    indexer.read_doc_map("docmap.txt"); // only present if the index was reordered
+    indexer.read_biwords("biwords.txt");   // without it phrases are answered from positions alone
+    indexer.read_forward("forward.bin");   // without it results are shown without snippets
+    if (!indexer.read_filter("filter.bin")) // turns away terms not in the index before the trie is walked
+        indexer.build_filter();
+    indexer.set_query_threads(0); // large queries use every core
 
-// Removes excess NOTs since two consecutive NOTs cancel one another
-void remove_excess_nots(vector<string>& v)
-{
-    const int len = v.size();
-    unsigned j = 0;
-    for (unsigned i = 0; i < len - 1 - j;)
+    if (memory)
     {
-        if (v[i] == v[i + 1] && v[i] == "not")
-        {
-            v.erase(v.begin() + i, v.begin() + i + 2); // Remvove both NOTs
-            j += 2;
-            continue;
-        }
-        i++;
+        indexer.memory_report().print(cout);
+        return 0;
     }
-}
 
-// Insert word
-bool insert_word(string& word, vector<string>& stack, vector<string>& postfix, short& a)
-{
-    if (word == "not") // operator
-    {
-        stack.push_back(word);
-        word.clear();
-        a = 2;
-    }
-    else if (word == "and" || word == "or")
+    cout << "The query operators (AND, OR, NOT) must be fully capitalised." << endl;
+    if (batch)
     {
-        if (a == 2) // 2 operators cannot appear consecutively unless second one is NOT
-            return false;
-        while (!stack.empty() && precedence(word) <= precedence(stack.back()))
+        cout << "Enter one query per line, then end the input:" << endl;
+        vector<vector<string>> queries;
+        for (string line; getline(cin, line);)
         {
-            postfix.push_back(stack.back());
-            stack.pop_back();
+            queries.emplace_back();
+            if (!parse_query(line, queries.back()))
+                queries.back().clear(); // an empty query is answered as incorrect
         }
-        stack.push_back(word);
-        word.clear();
-        a = 2;
-    }
-    else if (word.length()) // term
-    {
-        if (a == 1) // 2 terms cannot appear consecutively
-            return false;
-        postfix.push_back(word);
-        word.clear();
-        a = 1;
-    }
-    return true;
-}
-
-// Insert last word. Last word can never be an operator
-bool insert_last_word(string& word, vector<string>& stack, vector<string>& postfix, short& a)
-{
-    if (word == "not" || word == "and" || word == "or") // operator
-        return false;
-    else if (word.length()) // term
-    {
-        if (a == 1) // 2 terms cannot appear consecutively
-            return false;
-        postfix.push_back(word);
-        word.clear();
-        a = 1;
+        auto results = indexer.query_batch(queries);
+        for (auto &result : results)
+        {
+            if (!result.second)
+            {
+                cout << "\nIncorrect query!\n";
+                continue;
+            }
+            for (auto &i : result.first)
+                i = indexer.external_ID(i);
+            sort(result.first.begin(), result.first.end());
+            cout << "\nResult(s): ";
+            for (const auto &i : result.first)
+                cout << i << " ";
+            cout << endl;
+        }
+        if (disk)
+            indexer.cache_stats().print(cout << "\n");
+        return 0;
     }
-    return true;
-}
-
-int main()
-{
-    cout << "Reading index...\n" << endl;
-    Indexer indexer;
-    indexer.read("index.txt");
-
-    cout << "The query operators (AND, OR, NOT) must be fully capitalised." << endl;
     cout << "Enter a query: ";
     string query;
     getline(cin, query);
     
-    vector<string> postfix, stack;
-    const int length = query.length();
-
-    if (!bracket_check(query))
+    vector<string> postfix;
+    if (!parse_query(query, postfix))
     {
         cout << "\nIncorrect query!\n";
         return 0;
     }
-
-    string word;
-    short a = 0; // 1 if prev term was term, 2 if prev term was operator, 3 in case of /k
-
-    for (unsigned i = 0; i < length; i++)
+    if (explain)
     {
-        if ((query[i] >= 'a' && query[i] <= 'z') || (query[i] >= '0' && query[i] <= '9'))
-            word.push_back(query[i]);
-        else if (query[i] >= 'A' && query[i] <= 'Z')
-            word.push_back(query[i] | 32); // case folding
-        else if (query[i] == '(')
-            stack.push_back("(");
-        else if (query[i] == ')')
-        {
-            if (!insert_last_word(word, stack, postfix, a))
-            {
-                cout << "\nIncorrect query!\n";
-                return 0;
-            }
-            while (!stack.empty() && stack.back() != "(")
-            {
-                postfix.push_back(stack.back());
-                stack.pop_back();
-            }
-            stack.pop_back();
-        }
-        else if (query[i] == ' ')
-        {
-            if (!insert_word(word, stack, postfix, a))
-            {
-                cout << "\nIncorrect query!\n";
-                return 0;
-            }
-        }
-        else // Any other character
-        {
-            // That character is not part of a word so error thrown
-            if (i == 0 || query[i - 1] == ' ')
-            {
-                cout << "\nIncorrect query!\n";
-                return 0;
-            }
-            // Otherwise, character is part of word; however, it is still
-            // not pushed in word as these characters are ignored anyway
-        }
+        cout << "\n" << indexer.explain(postfix, true, json);
+        return 0;
     }
-    if (!insert_last_word(word, stack, postfix, a))
+    if (count)
     {
-        cout << "\nIncorrect query!\n";
+        auto counted = indexer.count(postfix);
+        if (!counted.second)
+            cout << "\nIncorrect query!\n";
+        else
+            cout << "\nMatching docs: " << counted.first << endl;
         return 0;
     }
-    while (!stack.empty())
+    if (exists)
     {
-        postfix.push_back(stack.back());
-        stack.pop_back();
+        auto found = indexer.exists(postfix);
+        if (!found.second)
+            cout << "\nIncorrect query!\n";
+        else
+            cout << "\n" << (found.first ? "Some docs match." : "No docs match.") << endl;
+        return 0;
     }
-    remove_excess_nots(postfix);
-    if (postfix.empty())
+    if (page)
     {
-        cout << "\nIncorrect query!\n";
+        auto result = indexer.query(postfix, PAGE_SIZE);
+        if (!result.second)
+        {
+            cout << "\nIncorrect query!\n";
+            return 0;
+        }
+        if (result.first.docs.empty())
+            cout << "\nSorry! No results were found!\n";
+        while (!result.first.docs.empty())
+        {
+            cout << "\nResult(s): ";
+            for (const auto &i : result.first.docs)
+                cout << indexer.external_ID(i) << " ";
+            cout << endl;
+            if (result.first.token.empty())
+                break;
+            cout << "More? (y/n) ";
+            string answer;
+            if (!getline(cin, answer) || answer != "y")
+                break;
+            result = indexer.resume(postfix, PAGE_SIZE, result.first.token);
+        }
         return 0;
     }
     auto result = indexer.query_eval(postfix);
@@ -189,14 +159,34 @@ int main()
         cout << "\nIncorrect query!\n";
         return 0;
     }
+    // A misspelled term empties the result, so try again with the terms closest to it
+    vector<string> corrected = postfix;
+    if (result.first.empty() && indexer.expand_fuzzy(corrected))
+    {
+        cout << "\nNo docs match; showing results for: " << to_infix(corrected) << endl;
+        result = indexer.query_eval(corrected);
+    }
     if (result.first.empty())
         cout << "\nSorry! No results were found!\n";
     else
     {
+        for (auto& i: result.first)
+            i = indexer.external_ID(i);
+        sort(result.first.begin(), result.first.end());
+
         cout << "\nResult(s): ";
         for (const auto& i: result.first)
             cout << i << " ";
         cout << endl;
+
+        for (size_t i = 0; i < result.first.size() && i < SNIPPETS; i++)
+        {
+            const unsigned ID = indexer.stored_ID(result.first[i]);
+            if (ID)
+                cout << "\n" << indexer.stored().path(ID) << ": " << indexer.snippet(ID, corrected) << endl;
+        }
     }
+    if (disk)
+        indexer.cache_stats().print(cout << "\n");
     return 0;
 }
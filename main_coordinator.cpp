@@ -0,0 +1,69 @@
+#include "Indexer/Build/Shards.hpp"
+#include "Indexer/Net/Coordinator.hpp"
+#include "Indexer/Net/QueryServer.hpp"
+#include <iostream>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <thread>
+using namespace std;
+
+// Usage: main_coordinator [socket_path] [timeout_ms] [manifest]
+// Serves the whole index from the shards listed in the manifest (written by main_index)
+// Shard i is served by a main_server process on shard<i>.sock, which is started
+// here unless one is already listening; the workers exit with the coordinator
+int main(int argc, char *argv[])
+{
+    const string path = argc > 1 ? argv[1] : "index.sock";
+    const unsigned timeout_ms = argc > 2 ? stoul(argv[2]) : 1000;
+    const char *manifest = argc > 3 ? argv[3] : "shards.txt";
+
+    vector<Shards::Range> ranges = Shards::read_manifest(manifest);
+    if (ranges.empty())
+    {
+        cout << "Cannot read " << manifest << "!\n";
+        return 1;
+    }
+
+    vector<string> shard_paths;
+    for (unsigned i = 0; i < ranges.size(); i++)
+    {
+        const string shard_path = "shard" + to_string(i + 1) + ".sock";
+        shard_paths.push_back(shard_path);
+        if (LineSocket::connect_to(shard_path).is_open())
+            continue;
+
+        if (fork() == 0)
+        {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            execl("./main_server", "main_server", shard_path.c_str(), ranges[i].filename.c_str(),
+                  to_string(ranges[i].first).c_str(), to_string(ranges[i].last).c_str(), (char *)nullptr);
+            _exit(1);
+        }
+    }
+
+    // Wait for every worker to finish loading its shard
+    for (const auto &shard_path : shard_paths)
+    {
+        unsigned waited = 0;
+        while (!LineSocket::connect_to(shard_path).is_open())
+        {
+            if (++waited > 600)
+            {
+                cout << "Shard " << shard_path << " did not start!\n";
+                return 1;
+            }
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+    }
+
+    Coordinator coordinator(shard_paths, timeout_ms);
+    QueryServer server([&coordinator](const string &request)
+                       { return coordinator.answer(request); });
+    cout << "Serving " << ranges.size() << " shards on " << path << endl;
+    if (!server.serve(path))
+    {
+        cout << "Cannot listen on " << path << "!\n";
+        return 1;
+    }
+    return 0;
+}
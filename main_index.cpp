@@ -1,19 +1,41 @@
 #include "Indexer/Indexer.hpp"
 #include <iostream>
 #define TOTAL (30)
+#define SHARDS (3)
+#define BIWORD_MIN_DOCS (3) // pairs in fewer docs get no biword unless phrases.txt asks for them
+#define FILTER_FALSE_POSITIVES (0.01) // share of terms not in the index that still walk the trie
 using namespace std;
 
 int main()
 {
-    unsigned id;
     Indexer indexer;
 
-    for (int id = 1; id <= TOTAL; id++) // Index files one by one
-    {
-        string filename = to_string(id) + ".txt";
-        indexer.index(("../Dataset/" + filename).c_str(), id);
-    }
+    vector<pair<string, unsigned>> files;
+    for (unsigned id = 1; id <= TOTAL; id++)
+        files.emplace_back("../Dataset/" + to_string(id) + ".txt", id);
+    // Reading, tokenizing and inverting overlap; the stats show which stage limits the others
+    indexer.collect_biwords();
+    indexer.collect_text(); // for result snippets, without opening the dataset again
+    indexer.index_files(files).print(cout);
+    // Phrases often asked for, one per line, keep their biwords however rare they are
+    vector<string> phrases;
+    ifstream phrase_file("phrases.txt");
+    for (string phrase; getline(phrase_file, phrase);)
+        phrases.push_back(phrase);
+    indexer.build_biwords(BIWORD_MIN_DOCS, phrases);
+    // Give similar docs nearby IDs before anything is written
+    auto stats = indexer.reorder(TOTAL);
+    stats.first.print(cout, "Before reordering");
+    stats.second.print(cout, "After reordering ");
+    indexer.write_doc_map("docmap.txt");
+    indexer.write_biwords("biwords.txt");
+    indexer.write_forward("forward.bin");
+
     indexer.write_on("index.txt");
+    indexer.write_filter("filter.bin", FILTER_FALSE_POSITIVES); // for every form of the index below
+    indexer.write_split("postings.txt", "positions.bin");
+    indexer.write_blocks("terms.txt", "blocks.bin"); // for an index served from disk
+    indexer.write_shards(SHARDS, "shards.txt", TOTAL);
     fflush(stdin);
     system("pause");
     return 0;
@@ -0,0 +1,319 @@
+#include "Indexer/Indexer.hpp"
+#include "Indexer/Net/Protocol.hpp"
+#include "Indexer/Net/UnixSocket.hpp"
+#include "Indexer/Query/Parser.hpp"
+#include "Indexer/Stats/Histogram.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+using namespace std;
+using Clock = chrono::steady_clock;
+
+// Usage: main_loadgen [options]
+//   --log file        replay the queries in file (one per line), looping over it
+//   --zipf n          generate n queries whose terms follow a Zipf law over doc_count rank (default 10000)
+//   --qps r           open loop: issue r queries per second whatever the latency
+//   --clients n       closed loop: n clients each sending their next query when the last one returns
+//   --threads n       threads issuing the open-loop schedule (default 4)
+//   --seconds s       length of every run (default 5)
+//   --interval-us u   expected interval between a closed-loop client's queries,
+//                     used to correct coordinated omission (default: mean latency)
+//   --socket path     query a running main_server instead of an in-process index
+//   --sweep a,b,c     open loop at a, a+b, ... c qps; stops at the first rate that cannot be sustained:
+//                     under 95% of it is achieved or the p99 response time is above the SLO
+//   --slo-us u        p99 response time the sweep accepts (default 10000)
+
+// Something that answers a query; every thread gets its own
+struct Target
+{
+    virtual ~Target() = default;
+    virtual bool run(const string &query) = 0;
+};
+
+struct InProcessTarget : Target
+{
+    Indexer &indexer;
+    vector<string> postfix;
+
+    InProcessTarget(Indexer &indexer)
+        : indexer(indexer) {}
+
+    bool run(const string &query) override
+    {
+        return parse_query(query, postfix) && indexer.query_eval(postfix).second;
+    }
+};
+
+struct SocketTarget : Target
+{
+    LineSocket socket;
+    string response;
+
+    SocketTarget(const string &path)
+        : socket(LineSocket::connect_to(path)) {}
+
+    bool run(const string &query) override
+    {
+        return socket.write_line(query) && socket.read_line(response) && response.compare(0, 2, "OK") == 0;
+    }
+};
+
+struct Options
+{
+    string log, socket;
+    unsigned zipf{10000};
+    double qps{0};
+    unsigned clients{0};
+    unsigned threads{4};
+    double seconds{5};
+    double interval_us{0};
+    double sweep_from{0}, sweep_step{0}, sweep_to{0};
+    double slo_us{10000};
+};
+
+struct Run
+{
+    Histogram service;  // time from sending a query to its answer
+    Histogram response; // open loop: time from when the query should have been sent
+    unsigned long long done{0}, failed{0};
+    double seconds{0};
+};
+
+// Queries whose terms are drawn with probability ~ 1 / rank, rank 1 being the term in most docs
+// Both index layouts start every line with "term doc_count"
+vector<string> zipf_queries(const unsigned &count)
+{
+    vector<pair<unsigned, string>> terms;
+    ifstream file(ifstream("postings.txt").good() ? "postings.txt" : "index.txt");
+    string term;
+    unsigned doc_count;
+    while (file >> term >> doc_count)
+    {
+        if (term != "and" && term != "or" && term != "not") // would be read as operators
+            terms.emplace_back(doc_count, term);
+        file.ignore(numeric_limits<streamsize>::max(), '\n');
+    }
+    sort(terms.rbegin(), terms.rend());
+
+    vector<double> weights;
+    for (unsigned rank = 1; rank <= terms.size(); rank++)
+        weights.push_back(1.0 / rank);
+    mt19937 rng(7);
+    discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    uniform_int_distribution<int> length(1, 3), coin(0, 9);
+
+    vector<string> queries;
+    const char *operators[] = {" AND ", " OR "};
+    for (unsigned i = 0; i < count && !terms.empty(); i++)
+    {
+        string query = terms[pick(rng)].second;
+        for (int k = length(rng); k > 1; k--)
+            query += operators[coin(rng) % 2] + string(coin(rng) < 2 ? "NOT " : "") + terms[pick(rng)].second;
+        queries.push_back(query);
+    }
+    return queries;
+}
+
+unique_ptr<Target> make_target(const Options &options, Indexer &indexer)
+{
+    if (options.socket.empty())
+        return unique_ptr<Target>(new InProcessTarget(indexer));
+    return unique_ptr<Target>(new SocketTarget(options.socket));
+}
+
+// Sends qps queries per second on a fixed schedule for the given time
+Run open_loop(const Options &options, Indexer &indexer, const vector<string> &queries, const double &qps)
+{
+    const auto interval = chrono::nanoseconds((long long)(1e9 / qps));
+    const auto start = Clock::now();
+    const auto end = start + chrono::nanoseconds((long long)(options.seconds * 1e9));
+    atomic<unsigned long long> next{0};
+
+    vector<Run> runs(options.threads);
+    vector<thread> workers;
+    for (unsigned t = 0; t < options.threads; t++)
+    {
+        workers.emplace_back([&, t]()
+        {
+            unique_ptr<Target> target = make_target(options, indexer);
+            Run &run = runs[t];
+            while (true)
+            {
+                unsigned long long i = next++;
+                const auto intended = start + i * interval;
+                if (intended >= end)
+                    break;
+                this_thread::sleep_until(intended);
+
+                const auto sent = Clock::now();
+                bool ok = target->run(queries[i % queries.size()]);
+                const auto answered = Clock::now();
+                run.service.record(chrono::duration_cast<chrono::nanoseconds>(answered - sent).count());
+                run.response.record(chrono::duration_cast<chrono::nanoseconds>(answered - intended).count());
+                ok ? run.done++ : run.failed++;
+            }
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+
+    Run total;
+    for (auto &run : runs)
+    {
+        total.service.merge(run.service);
+        total.response.merge(run.response);
+        total.done += run.done;
+        total.failed += run.failed;
+    }
+    total.seconds = chrono::duration<double>(Clock::now() - start).count();
+    return total;
+}
+
+// Every client sends its next query as soon as the last one is answered
+Run closed_loop(const Options &options, Indexer &indexer, const vector<string> &queries)
+{
+    const auto start = Clock::now();
+    const auto end = start + chrono::nanoseconds((long long)(options.seconds * 1e9));
+    atomic<unsigned long long> next{0};
+
+    vector<Run> runs(options.clients);
+    vector<thread> clients;
+    for (unsigned c = 0; c < options.clients; c++)
+    {
+        clients.emplace_back([&, c]()
+        {
+            unique_ptr<Target> target = make_target(options, indexer);
+            Run &run = runs[c];
+            while (Clock::now() < end)
+            {
+                const auto sent = Clock::now();
+                bool ok = target->run(queries[next++ % queries.size()]);
+                run.service.record(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - sent).count());
+                ok ? run.done++ : run.failed++;
+            }
+        });
+    }
+    for (auto &client : clients)
+        client.join();
+
+    Run total;
+    for (auto &run : runs)
+    {
+        total.service.merge(run.service);
+        total.done += run.done;
+        total.failed += run.failed;
+    }
+    total.seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    // A client stuck on a slow query did not send the queries it was due to;
+    // add them back as if they had waited for it
+    unsigned long long interval = options.interval_us * 1000;
+    if (interval == 0)
+        interval = total.service.mean();
+    total.response = total.service.corrected(interval);
+    return total;
+}
+
+void report(const Run &run, const char *response_label)
+{
+    cout << "Completed " << run.done << " queries (" << run.failed << " failed) in " << run.seconds
+         << " s: " << run.done / run.seconds << " qps\n";
+    run.service.print(cout, "Service time         ");
+    run.response.print(cout, response_label);
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string flag = argv[i], value = argv[i + 1];
+        if (flag == "--log")
+            options.log = value;
+        else if (flag == "--zipf")
+            options.zipf = stoul(value);
+        else if (flag == "--qps")
+            options.qps = stod(value);
+        else if (flag == "--clients")
+            options.clients = stoul(value);
+        else if (flag == "--threads")
+            options.threads = max(1ul, stoul(value));
+        else if (flag == "--seconds")
+            options.seconds = stod(value);
+        else if (flag == "--interval-us")
+            options.interval_us = stod(value);
+        else if (flag == "--slo-us")
+            options.slo_us = stod(value);
+        else if (flag == "--socket")
+            options.socket = value;
+        else if (flag == "--sweep")
+        {
+            char comma;
+            istringstream(value) >> options.sweep_from >> comma >> options.sweep_step >> comma >> options.sweep_to;
+        }
+        else
+        {
+            cout << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+    if (options.qps == 0 && options.clients == 0 && options.sweep_to == 0)
+        options.clients = 1;
+
+    Indexer indexer;
+    if (options.socket.empty())
+    {
+        cout << "Reading index...\n" << endl;
+        if (ifstream("postings.txt").good())
+            indexer.read_split("postings.txt", "positions.bin");
+        else
+            indexer.read_parallel("index.txt");
+    }
+
+    vector<string> queries;
+    if (!options.log.empty())
+    {
+        ifstream log(options.log);
+        string line;
+        while (getline(log, line))
+        {
+            if (!line.empty())
+                queries.push_back(line);
+        }
+    }
+    else
+        queries = zipf_queries(options.zipf);
+    if (queries.empty())
+    {
+        cout << "No queries to send!\n";
+        return 1;
+    }
+
+    if (options.sweep_to > 0)
+    {
+        // Find the highest rate the engine keeps up with
+        double sustained = 0;
+        for (double qps = options.sweep_from; qps <= options.sweep_to; qps += options.sweep_step)
+        {
+            Run run = open_loop(options, indexer, queries, qps);
+            const double achieved = (run.done + run.failed) / run.seconds;
+            cout << "target " << qps << " qps, achieved " << achieved << " qps, p50 "
+                 << run.response.percentile(50) / 1000.0 << " us, p99 "
+                 << run.response.percentile(99) / 1000.0 << " us\n";
+            if (achieved < 0.95 * qps || run.response.percentile(99) > options.slo_us * 1000)
+                break;
+            sustained = qps;
+            if (options.sweep_step <= 0)
+                break;
+        }
+        cout << "Saturation point: about " << sustained << " qps\n";
+    }
+    else if (options.qps > 0)
+        report(open_loop(options, indexer, queries, options.qps), "Response time (CO-free)");
+    else
+        report(closed_loop(options, indexer, queries), "Response time (CO-corrected)");
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "Indexer/Indexer.hpp"
+#include "Indexer/Net/Protocol.hpp"
+#include "Indexer/Net/QueryServer.hpp"
+#include "Indexer/Storage/LiveIndex.hpp"
+#include <iostream>
+#include <thread>
+#define WARM_UP_BYTES (256ull << 20) // read in before the index is used, for the terms asked for most
+#define WARM_UP_MS (2000)
+#define TERM_LOG_SECONDS (60)        // how often the term counts are written out
+using namespace std;
+
+// Usage: main_server [socket_path] [budget_bytes | index_file first_doc last_doc]
+// Answers queries over a Unix socket, one line per request (see Net/Protocol.hpp)
+// With a budget the index stays on disk (terms.txt, blocks.bin, positions.bin) and is read
+// through a block cache that keeps the server within budget_bytes (see Indexer::read_blocks)
+// With an index file the server is a shard holding the docs first_doc..last_doc (see main_coordinator)
+// The index files are read again, without interrupting queries, on SIGHUP
+// or on a "RELOAD" request, which answers once the new index is in use
+// How often each term is asked for is kept next to the index (termlog.txt, or the shard's
+// index file name with ".terms" added), and every index read is warmed up from it first
+int main(int argc, char *argv[])
+{
+    const string path = argc > 1 ? argv[1] : "index.sock";
+    const string log_name = argc > 4 ? string(argv[2]) + ".terms" : "termlog.txt";
+    TermLog log;
+    log.read(log_name.c_str());
+
+    LiveIndex live([&](Indexer &indexer)
+    {
+        if (argc > 4)
+        {
+            if (!indexer.read_parallel(argv[2]))
+                return false;
+            indexer.set_doc_range(stoul(argv[3]), stoul(argv[4]));
+        }
+        else if (argc == 3)
+        {
+            indexer.set_memory_budget(stoull(argv[2]));
+            if (!indexer.read_blocks("terms.txt", "blocks.bin", "positions.bin"))
+                return false;
+        }
+        else if (ifstream("postings.txt").good())
+        {
+            if (!indexer.read_split("postings.txt", "positions.bin"))
+                return false;
+        }
+        else if (!indexer.read_parallel("index.txt"))
+            return false;
+        indexer.read_doc_map("docmap.txt");
+        if (argc <= 4) // biwords hold every doc, so a shard answers phrases from positions
+            indexer.read_biwords("biwords.txt");
+        indexer.read_forward("forward.bin"); // a shard only gives snippets of its own docs
+        if (argc > 4 || !indexer.read_filter("filter.bin")) // a shard holds fewer terms
+            indexer.build_filter();
+        indexer.set_query_threads(0); // large queries use every core
+        log.write(log_name.c_str());
+        indexer.warm_up(log, WARM_UP_BYTES, WARM_UP_MS).print(cout);
+        indexer.set_term_log(&log);
+        return true;
+    });
+    live.reload_on_signal(SIGHUP); // before any other thread starts
+
+    cout << "Reading index...\n" << endl;
+    if (!live.reload())
+    {
+        cout << "Cannot read the index!\n";
+        return 1;
+    }
+
+    QueryServer server([&live](const string &request)
+    {
+        if (request == "RELOAD")
+            return live.reload() ? "OK generation " + to_string(live.generation()) : string("ERR reload failed");
+        return Protocol::answer(*live.current(), request);
+    });
+    thread([&log, &log_name]()
+    {
+        for (;;)
+        {
+            this_thread::sleep_for(chrono::seconds(TERM_LOG_SECONDS));
+            log.write(log_name.c_str());
+        }
+    }).detach();
+    cout << "Listening on " << path << endl;
+    if (!server.serve(path))
+    {
+        cout << "Cannot listen on " << path << "!\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,13 +1,14 @@
 #include <iostream>
 #include <vector>
-#include "Indexer/Tries/Trie.hpp"
+#include "Indexer/Indexer.hpp"
 using namespace std;
 
 int main(void)
 {
-    Trie t;
-    auto res = t.AND("cricket", "captain");
-    for (auto& r: res)
+    Indexer indexer;
+    indexer.read("index.txt");
+    auto res = indexer.query_eval({"cricket", "captain", "and"});
+    for (auto& r: res.first)
         cout << r << " ";
     return 0;
-}
\ No newline at end of file
+}